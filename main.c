@@ -31,18 +31,43 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#ifdef RAW_UINPUT
+#include <linux/uinput.h>
+#else
 #include <libevdev/libevdev-uinput.h>
+#endif
 #include <dirent.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <signal.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <time.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING 1
+#endif
+#endif
+
+#include "motion.h"
+#include "rules.h"
 
 /* Configuration */
 #define DEV_INPUT "/dev/input"
+#define DEV_UINPUT "/dev/uinput"
+#define DEV_NAME_MAX 80
 #define LOG_FILE "/cache/FlipMouse.log"
 #ifdef DEBUG
 #define ENABLE_LOG 1
@@ -53,6 +78,9 @@
 /* Control paths */
 #define CONTROL_SOCK     "/data/local/tmp/flipmouse/sock"
 #define STATUS_FILE      "/data/local/tmp/flipmouse/status"
+#define ADAPTIVE_FILE    "/data/local/tmp/flipmouse/adaptive"
+#define RULES_FILE       "/data/local/tmp/flipmouse/rules"
+#define RULES_TEXT_MAX   16384
 
 /* Pointer positioning behavior */
 #define PARK_STEP 200
@@ -60,8 +88,29 @@
 #define CENTER_STEP 20
 #define CENTER_SETTLE_US (2 * 1000)
 
+/* Screen for the cursor estimate (TCL Flip 2: wm size 240x320) */
+#define SCREEN_W_DEFAULT 240
+#define SCREEN_H_DEFAULT 320
+
 /* Constants */
 #define WHEEL_SLOWDOWN_FACTOR 5
+#define READ_BATCH 16 /* input_events read per read() */
+#define LAT_BUCKETS 32 /* log2 microsecond latency buckets */
+#define STARTUP_MAX_PHASES 32
+#define CONTROL_BACKLOG 64
+#define CONTROL_CLIENTS_MAX 16 /* accepted connections waiting for their command */
+#define CONTROL_CLIENT_TIMEOUT_MS 100
+
+/* Overload protection: a device is overloaded while it exceeds
+ * OVERLOAD_WINDOW_EVENTS per OVERLOAD_WINDOW_US, or while its events reach
+ * us more than OVERLOAD_AGE_US late */
+#define OVERLOAD_WINDOW_US 100000
+#define OVERLOAD_WINDOW_EVENTS 300 /* 3000 events/s; a keypad makes < 100 */
+#define OVERLOAD_AGE_US 20000
+#define KEY_LONGS ((KEY_CNT + 8 * sizeof(long) - 1) / (8 * sizeof(long)))
+
+/* Self-profiling: cycles, instructions, cache misses, branch misses */
+#define PERF_COUNTERS 4
 
 /* Event action return codes */
 typedef enum
@@ -79,39 +128,234 @@ typedef struct
   int keycode;
 } keymap_t;
 
+/* uinput output device (device clone or virtual mouse) */
+typedef struct
+{
+#ifdef RAW_UINPUT
+  int fd;
+#else
+  struct libevdev_uinput *uidev;
+#endif
+} uout_t;
+
+/* Capability of a uinput device we create ourselves. EV_ABS axes range
+ * over [0, max]; UCAP_PROP entries set an input property instead. */
+#define UCAP_PROP EV_CNT
+
+typedef struct
+{
+  unsigned short type;
+  unsigned short code;
+  int max;
+} ucap_t;
+
+/* Where clicks and drags go */
+typedef enum
+{
+  OUTPUT_POINTER = 0, /* BTN_LEFT on the virtual mouse */
+  OUTPUT_TOUCH        /* touches on the virtual touchscreen at the cursor estimate */
+} output_mode_t;
+
+/* Work the control thread hands to the translating thread; see translator_post() */
+typedef enum
+{
+  TRANSLATOR_MODE = 0,     /* write_status_file(), on_enabled_transition(was, now) */
+  TRANSLATOR_ADAPTIVE_SAVE /* adaptive_save() */
+} translator_op_t;
+
+/* Clone lifecycle; clones are created in the background after the scan */
+typedef enum
+{
+  CLONE_NONE = 0,  /* not grabbed: the system already sees its events */
+  CLONE_PENDING,   /* creation thread running */
+  CLONE_READY,
+  CLONE_FAILED
+} clone_state_t;
+
 /* Device structure */
 typedef struct dev_st
 {
   int fd;
-  const char *name;
+  char name[DEV_NAME_MAX];
+#ifndef RAW_UINPUT
   struct libevdev *evdev;
-  struct libevdev_uinput *uidev;
+#endif
+  atomic_int grabbed;         /* cleared by the translator if the clone fails */
+  clone_state_t clone_state;
+  int clone_rc;
+  pthread_t clone_thread;
+  uout_t out;
+
+  /* overload protection, owned by the translating thread */
+  long long window_start_us;
+  unsigned window_events;
+  int overloaded;
+  int syn_dropped;            /* discarding until the next SYN_REPORT */
+  unsigned long keys[KEY_LONGS]; /* key state as read from the device */
+  unsigned rules_mask;        /* which device="..." rule conditions match */
+
   struct dev_st *next;
 } device_t;
 
-/* Mouse configuration structure */
+/* Mouse configuration structure (shared with the control thread) */
 typedef struct
 {
-  int enabled;
+  atomic_int enabled;
   long long toggle_down_at_ms;
-  int speed;
-  int drag_mode;
-  struct libevdev *dev;
-  struct libevdev_uinput *uidev;
+  atomic_int speed;    /* effective step, published from the motion state */
+  atomic_int adaptive; /* requested by --adaptive or the control socket */
+  atomic_int gain;     /* motion state published for `adaptive` */
+  atomic_uint overshoots;
+  atomic_uint long_runs;
+  atomic_int drag_mode;
+  uout_t out;
+  pthread_t create_thread;
+  int create_pending;
+  int create_rc;
+
+  /*
+   * Cursor estimate in screen pixels, tracked from our own REL output.
+   * x100/y100, touch_down and touch_id belong to the translating thread;
+   * the control thread reaches them only through translator_post().
+   */
+  int screen_w, screen_h;
+  int scale_pct;  /* screen pixels per 100 REL units */
+  long x100, y100; /* hundredths of a pixel */
+  atomic_int x, y; /* published for `output` */
+
+  /* direct-touch output */
+  atomic_int output; /* output_mode_t */
+  uout_t touch;      /* set once before touch_ready */
+  atomic_int touch_ready;
+  int touch_down;
+  int touch_id;
 } mouse_t;
 
+/* Input-to-uinput latency histogram; bucket i counts [2^i, 2^(i+1)) us */
+typedef struct
+{
+  atomic_uint count;
+  atomic_uint max_us;
+  atomic_uint buckets[LAT_BUCKETS];
+} latency_t;
+
+/* What overload protection did, reported by `stats` */
+typedef struct
+{
+  atomic_uint batches;     /* batches handled while overloaded */
+  atomic_uint shed;        /* repeat frames dropped */
+  atomic_uint merged;      /* REL events folded into another frame */
+  atomic_uint syn_dropped; /* kernel buffer overflows (SYN_DROPPED) */
+  atomic_uint resyncs;     /* key state resyncs after an overflow */
+} overload_t;
+
+/* Event paths measured by the self-profiler */
+typedef enum
+{
+  PERF_PATH_PASS = 0, /* forwarded to a device clone */
+  PERF_PATH_MOUSE,    /* translated (or muted) in mouse mode */
+  PERF_PATH_TOGGLE,
+  PERF_PATH_CONTROL,  /* one control socket command */
+  PERF_PATHS
+} perf_path_t;
+
+typedef struct
+{
+  atomic_ullong count;
+  atomic_ullong ns;
+  atomic_ullong hw_count; /* samples that also have hardware counts */
+  atomic_ullong hw[PERF_COUNTERS];
+} perf_stat_t;
+
+typedef struct
+{
+  atomic_int enabled;
+  perf_stat_t paths[PERF_PATHS];
+} perf_prof_t;
+
+/* Counter snapshot taken when a measured section starts */
+typedef struct
+{
+  long long t_ns; /* 0 = profiling off */
+  int hw;
+  unsigned long long hw_start[PERF_COUNTERS];
+} perf_sample_t;
+
+/* Motion accumulated while overloaded, flushed as a single frame */
+typedef struct
+{
+  int dx, dy, wheel, hwheel;
+  unsigned count;
+  struct input_event first; /* timestamp source for latency stats */
+} rel_merge_t;
+
+/* One timed startup phase, relative to process start */
+typedef struct
+{
+  char name[40];
+  long long start_us;
+  long long dur_us;
+  unsigned count; /* >1 when several steps are summed, like the probes */
+} startup_phase_t;
+
+typedef struct
+{
+  pthread_mutex_t lock; /* clone threads record their own phases */
+  long long t0_us;
+  long long ready_us;
+  size_t count;
+  size_t dropped; /* phases past STARTUP_MAX_PHASES */
+  startup_phase_t phases[STARTUP_MAX_PHASES];
+} startup_prof_t;
+
+/* User rules; see rules.h */
+typedef struct
+{
+  rules_t *active;            /* owned by the translating thread */
+  _Atomic(rules_t *) pending; /* set by rules_reload(), adopted on the next event */
+  atomic_uint count;          /* summary for the control thread */
+  atomic_uint insns;
+  atomic_uint worst_case;
+} rules_state_t;
+
+/* Event loop backend */
+typedef struct
+{
+  const char *name;
+  int (*run)(void);
+  void (*write)(const uout_t *out, const struct input_event *evs, size_t n);
+  void (*flush)(void);
+  void (*watch_client)(int fd); /* wake up when an accepted control client is readable */
+} loop_backend_t;
+
+/* Control connection accepted but not yet answered */
+typedef struct
+{
+  int fd;
+  long long accepted_us;
+} control_client_t;
+
 /* Global state */
 typedef struct
 {
+  const loop_backend_t *loop;
   device_t *devices;
   mouse_t mouse;
   FILE *log_fp;
   const keymap_t *keymap;
   size_t keymap_size;
-  volatile sig_atomic_t running;
-
-  /* control interface state */
+  motion_t motion; /* owned by the translating thread */
+  atomic_int running;
+  latency_t latency;
+  overload_t overload;
+  perf_prof_t perf;
+  rules_state_t rules;
+  startup_prof_t startup;
+
+  /* control interface state, owned by the thread serving the socket */
   int control_fd;
+  control_client_t clients[CONTROL_CLIENTS_MAX];
+  size_t nclients;
 } app_state_t;
 
 /* Device list */
@@ -119,6 +363,7 @@ static const char *supported_devices[] = {
     "mtk-kpd",
     "matrix-keypad",
     "AT Translated Set 2 keyboard", /* Laptop Keyboard */
+    "FlipMouse Bench Keyboard",     /* tools/bench.c */
     NULL};
 
 /* Keymap configurations */
@@ -142,20 +387,58 @@ static const keymap_t laptop_keymap[] = {
     {88, KEY_HELP} /* F12 key */
 };
 
+/* Virtual mouse capabilities */
+static const ucap_t mouse_caps[] = {
+    {EV_REL, REL_X, 0},
+    {EV_REL, REL_Y, 0},
+    {EV_REL, REL_WHEEL, 0},
+    {EV_REL, REL_HWHEEL, 0},
+    {EV_KEY, BTN_LEFT, 0},
+    {EV_KEY, BTN_RIGHT, 0}};
+
 /* Global application state */
 static app_state_t app_state = {0};
 
 /* Function prototypes */
 /* Mouse handling */
 static int mouse_init(void);
+static int mouse_wait_ready(void);
 static void mouse_cleanup(void);
 static int mouse_toggle(struct input_event *ev);
 static int mouse_handle_event(device_t *dev, struct input_event *ev);
+static int mouse_motion_step(motion_dir_t dir, const struct input_event *ev);
+static void motion_publish(void);
+
+/* Cursor estimate and direct touch */
+static int touch_init(void);
+static void cursor_track(const struct input_event *evs, size_t n);
+static void touch_set(int down, const struct input_event *src);
+
+/* Adaptive speed persistence */
+static void adaptive_load(void);
+static void adaptive_save(void);
+
+/* User rules */
+static int rules_reload(const char *text, char *err, size_t errlen);
+static int rules_apply(device_t *dev, struct input_event *ev);
 
 /* Device handling */
 static int devices_find_and_init(void);
+static void device_free(device_t *dev);
+static void device_start_clone(device_t *dev);
+static const uout_t *device_output(device_t *dev);
 static void devices_cleanup(void);
 
+/* uinput backend (libevdev, or raw ioctls with -DRAW_UINPUT) */
+static int input_probe(device_t *dev);
+static int input_has_code(const device_t *dev, unsigned int type, unsigned int code);
+static void uout_reset(uout_t *out);
+static int uout_create(uout_t *out, const char *name, const ucap_t *caps, size_t ncaps);
+static int uout_clone(uout_t *out, const device_t *dev);
+static void uout_write(const uout_t *out, const struct input_event *evs, size_t n);
+static int uout_fd(const uout_t *out);
+static void uout_destroy(uout_t *out);
+
 /* Event handling */
 static int handle_input_event(device_t *dev, struct input_event *ev);
 static int keymap_get_keycode(int scanvalue);
@@ -176,6 +459,8 @@ static void setup_signal_handlers(void);
 static int control_init(void);
 static void control_cleanup(void);
 static void control_handle_ready(void);
+static void control_serve_clients(void);
+static int control_fdset(fd_set *set, int maxfd);
 static void write_status_file(void);
 static int control_send_cmd(const char *cmd);
 
@@ -184,18 +469,377 @@ static void rel_emit(int dx, int dy);
 static void park_bottom_right(void);
 static void move_from_park_to_center(void);
 static void on_enabled_transition(int was_enabled, int now_enabled, const char *why);
+static void translator_post(translator_op_t op, int was, int now);
 
 static long long ev_time_ms(const struct input_event *ev);
+static long long mono_us(void);
+
+/* Startup profiler */
+static void startup_begin(void);
+static void startup_phase(const char *name, const char *detail, long long start_us);
+static void startup_phase_sum(const char *name, unsigned count, long long start_us, long long dur_us);
+static void startup_ready(void);
+static void startup_report(int fd);
+
+/* Latency stats */
+static void latency_record_frame(const struct input_event *evs, size_t n);
+static unsigned latency_percentile(unsigned pct);
+static void latency_reset(void);
+
+/* Self-profiling (perf_event) */
+static void perf_begin(perf_sample_t *s);
+static void perf_end(const perf_sample_t *s, perf_path_t path);
+static void perf_report(int fd);
+static void perf_reset(void);
 
 /* Main loop */
+static void emit_write(const uout_t *out, const struct input_event *evs, size_t n);
+static void emit_flush(void);
+static void emit_event(const uout_t *out, const struct input_event *ev);
+static void process_events(device_t *d, struct input_event *evs, size_t n);
+static void process_event(device_t *d, struct input_event *ev, rel_merge_t *merge);
+static int run_select_loop(void);
+
+/* Overload protection */
+static int overload_check(device_t *d, const struct input_event *evs, size_t n);
+static size_t frame_repeat_end(const struct input_event *evs, size_t n, size_t i);
+static void rel_merge_add(rel_merge_t *m, const struct input_event *ev);
+static void rel_merge_flush(rel_merge_t *m);
+static void device_resync_keys(device_t *d);
+static void overload_reset(void);
 static int run_event_loop(void);
 
+#ifdef HAVE_IO_URING
+static int run_uring_loop(void);
+static void uring_queue_write(const uout_t *out, const struct input_event *evs, size_t n);
+static void uring_submit(void);
+static void uring_watch_client(int fd);
+#endif
+
+static int run_pipeline_loop(void);
+static void pipeline_queue_write(const uout_t *out, const struct input_event *evs, size_t n);
+
+/* Event loop backends, selected with --loop=<name> */
+static const loop_backend_t loop_backends[] = {
+    {"select", run_select_loop, uout_write, NULL, NULL},
+#ifdef HAVE_IO_URING
+    {"uring", run_uring_loop, uring_queue_write, uring_submit, uring_watch_client},
+#endif
+    {"pipeline", run_pipeline_loop, pipeline_queue_write, NULL, NULL},
+    {NULL, NULL, NULL, NULL, NULL}};
+
 static long long ev_time_ms(const struct input_event *ev)
 {
   return ((long long)ev->input_event_sec * 1000LL) +
          ((long long)ev->input_event_usec / 1000LL);
 }
 
+static long long mono_us(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/* --- Startup Profiler --- */
+
+static void startup_begin(void)
+{
+  pthread_mutex_init(&app_state.startup.lock, NULL);
+  app_state.startup.t0_us = mono_us();
+}
+
+static void startup_record(const char *name, const char *detail, long long start_us,
+                           long long dur_us, unsigned count)
+{
+  startup_prof_t *sp = &app_state.startup;
+
+  pthread_mutex_lock(&sp->lock);
+  if (sp->count >= STARTUP_MAX_PHASES)
+  {
+    sp->dropped++;
+  }
+  else
+  {
+    startup_phase_t *ph = &sp->phases[sp->count++];
+
+    if (detail)
+      snprintf(ph->name, sizeof(ph->name), "%s:%s", name, detail);
+    else
+      snprintf(ph->name, sizeof(ph->name), "%s", name);
+
+    /* Device names have spaces; keep the report key=value friendly */
+    for (char *c = ph->name; *c; c++)
+      if (*c == ' ') *c = '_';
+
+    ph->start_us = start_us - sp->t0_us;
+    ph->dur_us = dur_us;
+    ph->count = count;
+  }
+  pthread_mutex_unlock(&sp->lock);
+}
+
+/* Record a phase that began at start_us (a mono_us() value) and ends now */
+static void startup_phase(const char *name, const char *detail, long long start_us)
+{
+  startup_record(name, detail, start_us, mono_us() - start_us, 1);
+}
+
+/* Record count steps taking dur_us in total, the first starting at start_us */
+static void startup_phase_sum(const char *name, unsigned count, long long start_us, long long dur_us)
+{
+  startup_record(name, NULL, start_us, dur_us, count);
+}
+
+static void startup_ready(void)
+{
+  app_state.startup.ready_us = mono_us() - app_state.startup.t0_us;
+  log_message("Ready %lld.%01lldms after start",
+              app_state.startup.ready_us / 1000, (app_state.startup.ready_us % 1000) / 100);
+}
+
+/* Full breakdown, one phase per line */
+static void startup_report(int fd)
+{
+  startup_prof_t *sp = &app_state.startup;
+
+  pthread_mutex_lock(&sp->lock);
+  dprintf(fd, "ready_ms=%.1f phases=%zu dropped=%zu\n",
+          sp->ready_us / 1000.0, sp->count, sp->dropped);
+  for (size_t i = 0; i < sp->count; i++)
+  {
+    dprintf(fd, "%-32s start_ms=%7.1f dur_ms=%7.1f",
+            sp->phases[i].name,
+            sp->phases[i].start_us / 1000.0,
+            sp->phases[i].dur_us / 1000.0);
+    if (sp->phases[i].count > 1) dprintf(fd, " count=%u", sp->phases[i].count);
+    dprintf(fd, "\n");
+  }
+  pthread_mutex_unlock(&sp->lock);
+}
+
+/* --- Latency Stats --- */
+
+/*
+ * Grabbed devices report CLOCK_MONOTONIC timestamps (EVIOCSCLOCKID), and
+ * forwarded frames carry the source timestamp in their first event, so the
+ * latency is measured once the frame's write to uinput has completed. The
+ * kernel restamps injected events, so the carried time never leaks out.
+ *
+ * Every loop records one sample per frame, from its first non-SYN event;
+ * SYN-only frames are skipped. That keeps the numbers comparable between
+ * the loops, which finish their writes in different places.
+ */
+static void latency_record_frame(const struct input_event *evs, size_t n)
+{
+  const struct input_event *ev = evs;
+
+  while (ev < evs + n && ev->type == EV_SYN) ev++;
+  if (ev == evs + n) return;
+
+  long long t = (long long)ev->input_event_sec * 1000000LL + ev->input_event_usec;
+  if (!t) return;
+
+  long long d = mono_us() - t;
+  if (d < 0) d = 0;
+  unsigned us = d > 0xffffffffLL ? 0xffffffffU : (unsigned)d;
+
+  unsigned b = 0;
+  while ((us >> b) > 1 && b < LAT_BUCKETS - 1) b++;
+
+  latency_t *lat = &app_state.latency;
+  atomic_fetch_add_explicit(&lat->buckets[b], 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&lat->count, 1, memory_order_relaxed);
+
+  unsigned max = atomic_load_explicit(&lat->max_us, memory_order_relaxed);
+  while (us > max &&
+         !atomic_compare_exchange_weak_explicit(&lat->max_us, &max, us,
+                                                memory_order_relaxed, memory_order_relaxed))
+    ;
+}
+
+/* Upper bound of the bucket holding the given percentile, in us */
+static unsigned latency_percentile(unsigned pct)
+{
+  latency_t *lat = &app_state.latency;
+  unsigned long long total = atomic_load_explicit(&lat->count, memory_order_relaxed);
+  unsigned long long want = (total * pct + 99) / 100;
+  unsigned long long seen = 0;
+
+  if (!total) return 0;
+
+  for (unsigned b = 0; b < LAT_BUCKETS; b++)
+  {
+    seen += atomic_load_explicit(&lat->buckets[b], memory_order_relaxed);
+    if (seen >= want) return b >= 31 ? 0xffffffffU : (2U << b);
+  }
+  return 0xffffffffU;
+}
+
+static void latency_reset(void)
+{
+  latency_t *lat = &app_state.latency;
+  for (unsigned b = 0; b < LAT_BUCKETS; b++)
+    atomic_store_explicit(&lat->buckets[b], 0, memory_order_relaxed);
+  atomic_store_explicit(&lat->count, 0, memory_order_relaxed);
+  atomic_store_explicit(&lat->max_us, 0, memory_order_relaxed);
+}
+
+/* --- Self-Profiling (perf_event) --- */
+
+/*
+ * With --perf (or `perf on`) every handled event and control command is
+ * bracketed by two reads of a per-thread perf_event group (cycles leader
+ * plus instructions, cache misses and branch misses), and the deltas are
+ * added to the event's path. Kernel time is included where allowed. Only
+ * the select loop writes to uinput inside that bracket, so only there do
+ * the writes count against the path that made them; the uring loop writes
+ * at submit or completion and the pipeline loop on its writer thread, and
+ * their paths leave the write out (reported as writes=). If the kernel
+ * refuses perf events (perf_event_paranoid, seccomp, no PMU) the paths
+ * are still timed with CLOCK_MONOTONIC.
+ *
+ * Each sample costs two read() syscalls, so leave it off in normal use.
+ */
+
+static const char *const perf_path_names[PERF_PATHS] = {"pass", "mouse", "toggle", "control"};
+
+/* -2 = not opened yet on this thread, -1 = unavailable */
+static __thread int perf_group_fd = -2;
+
+static int perf_open_group(void)
+{
+  static const unsigned long long configs[PERF_COUNTERS] = {
+      PERF_COUNT_HW_CPU_CYCLES,
+      PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_CACHE_MISSES,
+      PERF_COUNT_HW_BRANCH_MISSES};
+  int fds[PERF_COUNTERS];
+
+  /* Try with kernel time first, then user space only */
+  for (int exclude_kernel = 0; exclude_kernel <= 1; exclude_kernel++)
+  {
+    int n = 0;
+
+    for (; n < PERF_COUNTERS; n++)
+    {
+      struct perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.size = sizeof(attr);
+      attr.config = configs[n];
+      attr.read_format = PERF_FORMAT_GROUP;
+      attr.disabled = n == 0;
+      attr.exclude_kernel = exclude_kernel;
+      attr.exclude_hv = 1;
+
+      fds[n] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, n ? fds[0] : -1, PERF_FLAG_FD_CLOEXEC);
+      if (fds[n] < 0) break;
+    }
+
+    if (n == PERF_COUNTERS)
+    {
+      ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+      log_message("perf counters enabled%s", exclude_kernel ? " (user space only)" : "");
+      return fds[0];
+    }
+
+    int err = errno;
+    while (n-- > 0) close(fds[n]);
+    errno = err;
+  }
+
+  log_message("perf events unavailable (%s); timing only", strerror(errno));
+  return -1;
+}
+
+static int perf_read_group(unsigned long long *vals)
+{
+  unsigned long long buf[1 + PERF_COUNTERS];
+
+  if (read(perf_group_fd, buf, sizeof(buf)) != (ssize_t)sizeof(buf) || buf[0] != PERF_COUNTERS)
+    return -1;
+  memcpy(vals, &buf[1], sizeof(buf) - sizeof(buf[0]));
+  return 0;
+}
+
+static void perf_begin(perf_sample_t *s)
+{
+  s->t_ns = 0;
+  if (!atomic_load_explicit(&app_state.perf.enabled, memory_order_relaxed)) return;
+
+  if (perf_group_fd == -2) perf_group_fd = perf_open_group();
+  s->hw = perf_group_fd >= 0 && perf_read_group(s->hw_start) == 0;
+
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  s->t_ns = (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void perf_end(const perf_sample_t *s, perf_path_t path)
+{
+  struct timespec ts;
+  unsigned long long now[PERF_COUNTERS];
+
+  if (!s->t_ns) return;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  long long ns = (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec - s->t_ns;
+
+  perf_stat_t *st = &app_state.perf.paths[path];
+  atomic_fetch_add_explicit(&st->count, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&st->ns, (unsigned long long)ns, memory_order_relaxed);
+
+  if (!s->hw || perf_read_group(now) < 0) return;
+
+  atomic_fetch_add_explicit(&st->hw_count, 1, memory_order_relaxed);
+  for (int i = 0; i < PERF_COUNTERS; i++)
+    atomic_fetch_add_explicit(&st->hw[i], now[i] - s->hw_start[i], memory_order_relaxed);
+}
+
+/* One line per path with per-event averages */
+static void perf_report(int fd)
+{
+  dprintf(fd, "perf loop=%s writes=%s\n", app_state.loop->name,
+          app_state.loop->write == uout_write ? "included" : "excluded");
+
+  for (int p = 0; p < PERF_PATHS; p++)
+  {
+    perf_stat_t *st = &app_state.perf.paths[p];
+    unsigned long long n = atomic_load_explicit(&st->count, memory_order_relaxed);
+    unsigned long long hn = atomic_load_explicit(&st->hw_count, memory_order_relaxed);
+
+    dprintf(fd, "perf path=%s events=%llu ns=%.0f", perf_path_names[p], n,
+            n ? (double)atomic_load(&st->ns) / n : 0.0);
+
+    if (!hn)
+    {
+      dprintf(fd, " counters=%s\n", n ? "unavailable" : "none");
+      continue;
+    }
+
+    double cycles = (double)atomic_load(&st->hw[0]) / hn;
+    double insns = (double)atomic_load(&st->hw[1]) / hn;
+    dprintf(fd, " cycles=%.0f instructions=%.0f ipc=%.2f cache_misses=%.1f branch_misses=%.1f\n",
+            cycles, insns, cycles > 0 ? insns / cycles : 0.0,
+            (double)atomic_load(&st->hw[2]) / hn,
+            (double)atomic_load(&st->hw[3]) / hn);
+  }
+}
+
+static void perf_reset(void)
+{
+  for (int p = 0; p < PERF_PATHS; p++)
+  {
+    perf_stat_t *st = &app_state.perf.paths[p];
+    atomic_store_explicit(&st->count, 0, memory_order_relaxed);
+    atomic_store_explicit(&st->ns, 0, memory_order_relaxed);
+    atomic_store_explicit(&st->hw_count, 0, memory_order_relaxed);
+    for (int i = 0; i < PERF_COUNTERS; i++)
+      atomic_store_explicit(&st->hw[i], 0, memory_order_relaxed);
+  }
+}
+
 /* --- Logging Functions --- */
 
 static void log_init(void)
@@ -255,6 +899,14 @@ static void log_event(const char *prefix, struct input_event *ev)
   if (!ENABLE_LOG || ev->type == EV_SYN) return;
 
   char event_info[256];
+#ifdef RAW_UINPUT
+  /* No name tables without libevdev */
+  const char *type_name = "-";
+  const char *code_name = "-";
+#else
+  const char *type_name = libevdev_event_type_get_name(ev->type);
+  const char *code_name = libevdev_event_code_get_name(ev->type, ev->code);
+#endif
   snprintf(event_info, sizeof(event_info),
            "%s [%s] Event: time %ld.%06ld, type %d (%s), code %d (%s), value %d",
            prefix,
@@ -262,9 +914,9 @@ static void log_event(const char *prefix, struct input_event *ev)
            ev->input_event_sec,
            ev->input_event_usec,
            ev->type,
-           libevdev_event_type_get_name(ev->type),
+           type_name ? type_name : "?",
            ev->code,
-           libevdev_event_code_get_name(ev->type, ev->code),
+           code_name ? code_name : "?",
            ev->value);
 
   log_message("%s", event_info);
@@ -294,692 +946,2739 @@ static int keymap_get_keycode(int scanvalue)
 
 /* --- Status file --- */
 
+/* Translating thread only (or main before the loop starts): O_TRUNC rewrites must not overlap */
 static void write_status_file(void)
 {
   int fd = open(STATUS_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0666);
   if (fd < 0) return;
   dprintf(fd, "enabled=%d speed=%d drag=%d\n",
           app_state.mouse.enabled, app_state.mouse.speed, app_state.mouse.drag_mode);
+
+  /* Compact startup breakdown: startup ready_ms=... <phase>=<ms> ... */
+  startup_prof_t *sp = &app_state.startup;
+  pthread_mutex_lock(&sp->lock);
+  dprintf(fd, "startup ready_ms=%.1f", sp->ready_us / 1000.0);
+  for (size_t i = 0; i < sp->count; i++)
+    dprintf(fd, " %s=%.1f", sp->phases[i].name, sp->phases[i].dur_us / 1000.0);
+  dprintf(fd, " dropped=%zu\n", sp->dropped);
+  pthread_mutex_unlock(&sp->lock);
+
   close(fd);
 }
 
-/* --- Pointer positioning (REL-only) --- */
+/* --- uinput Backend --- */
 
-static void rel_emit(int dx, int dy)
-{
-  if (!app_state.mouse.uidev) return;
+#ifdef RAW_UINPUT
+
+#define BITS_PER_LONG (sizeof(long) * 8)
+#define NLONGS(x) (((x) + BITS_PER_LONG - 1) / BITS_PER_LONG)
 
-  if (dx) libevdev_uinput_write_event(app_state.mouse.uidev, EV_REL, REL_X, dx);
-  if (dy) libevdev_uinput_write_event(app_state.mouse.uidev, EV_REL, REL_Y, dy);
-  libevdev_uinput_write_event(app_state.mouse.uidev, EV_SYN, SYN_REPORT, 0);
+static int test_bit(unsigned int bit, const unsigned long *bits)
+{
+  return (bits[bit / BITS_PER_LONG] >> (bit % BITS_PER_LONG)) & 1;
 }
 
-static void park_bottom_right(void)
+/* UI_SET_*BIT request for an event type, or 0 if codes are not forwarded */
+static unsigned long uinput_setbit_req(unsigned int type)
 {
-  /* Slam down-right enough times to guarantee we hit the BR edge. */
-  for (int i = 0; i < PARK_REPS; i++)
+  switch (type)
   {
-    rel_emit(PARK_STEP, PARK_STEP);
-    usleep(CENTER_SETTLE_US);
+  case EV_KEY: return UI_SET_KEYBIT;
+  case EV_REL: return UI_SET_RELBIT;
+  case EV_ABS: return UI_SET_ABSBIT;
+  case EV_MSC: return UI_SET_MSCBIT;
+  case EV_LED: return UI_SET_LEDBIT;
+  case EV_SND: return UI_SET_SNDBIT;
+  case EV_SW:  return UI_SET_SWBIT;
+  default:     return 0;
   }
-  log_message("Pointer parked bottom-right (REL slam)");
 }
 
-static void move_from_park_to_center(void)
+/*
+ * Name/id the device and create it. Kernels older than 4.5 lack
+ * UI_DEV_SETUP, so fall back to writing the legacy uinput_user_dev.
+ */
+static int uinput_finish(int ufd, const char *name, const struct input_id *id,
+                         struct uinput_user_dev *legacy)
 {
-  int left = 40;
-  int up   = 60;
+  struct uinput_setup setup;
+  memset(&setup, 0, sizeof(setup));
+  setup.id = *id;
+  strncpy(setup.name, name, sizeof(setup.name) - 1);
 
-  /* Move X first, then Y. Some stacks do weird things when both axes change together. */
-  while (left > 0)
+  if (ioctl(ufd, UI_DEV_SETUP, &setup) < 0)
   {
-    int step = (left > CENTER_STEP) ? CENTER_STEP : left;
-    rel_emit(-step, 0);
-    left -= step;
-    usleep(CENTER_SETTLE_US);
+    legacy->id = *id;
+    strncpy(legacy->name, name, sizeof(legacy->name) - 1);
+    if (write(ufd, legacy, sizeof(*legacy)) != sizeof(*legacy))
+    {
+      log_perror("write(uinput_user_dev)");
+      return -1;
+    }
   }
 
-  while (up > 0)
+  if (ioctl(ufd, UI_DEV_CREATE) < 0)
   {
-    int step = (up > CENTER_STEP) ? CENTER_STEP : up;
-    rel_emit(0, -step);
-    up -= step;
-    usleep(CENTER_SETTLE_US);
+    log_perror("ioctl(UI_DEV_CREATE)");
+    return -1;
   }
+  return 0;
 }
 
-static void on_enabled_transition(int was_enabled, int now_enabled, const char *why)
-{
-  if (was_enabled == now_enabled) return;
+#endif /* RAW_UINPUT */
 
-  if (!was_enabled && now_enabled)
+/* Open a /dev/input node and read its name (plus full state with libevdev) */
+static int input_probe(device_t *dev)
+{
+#ifdef RAW_UINPUT
+  if (ioctl(dev->fd, EVIOCGNAME(sizeof(dev->name)), dev->name) < 0)
   {
-    /* enabling: re-sync position then go to center */
-    park_bottom_right();
-    move_from_park_to_center();
-    log_message("Mouse enabled (%s)", why);
+    log_perror("ioctl(EVIOCGNAME)");
+    return -1;
   }
-  else if (was_enabled && !now_enabled)
+  dev->name[sizeof(dev->name) - 1] = 0;
+#else
+  if (libevdev_new_from_fd(dev->fd, &dev->evdev) < 0)
   {
-    /* disabling: park */
-    park_bottom_right();
-    log_message("Mouse disabled (%s)", why);
+    dev->evdev = NULL;
+    return -1;
   }
+  snprintf(dev->name, sizeof(dev->name), "%s", libevdev_get_name(dev->evdev));
+#endif
+  return 0;
 }
 
-/* --- Control Interface (socket) --- */
+static void uout_reset(uout_t *out)
+{
+#ifdef RAW_UINPUT
+  out->fd = -1;
+#else
+  out->uidev = NULL;
+#endif
+}
 
-static int control_init(void)
+static int uout_create(uout_t *out, const char *name, const ucap_t *caps, size_t ncaps)
 {
-  app_state.control_fd = -1;
+#ifdef RAW_UINPUT
+  struct uinput_user_dev legacy;
+  struct input_id id = {BUS_VIRTUAL, 0, 0, 0};
 
-  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
-  if (fd < 0)
+  memset(&legacy, 0, sizeof(legacy));
+  out->fd = open(DEV_UINPUT, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+  if (out->fd < 0)
   {
-    log_perror("socket(AF_UNIX)");
+    log_perror("open(" DEV_UINPUT ")");
     return -1;
   }
 
-  /* Make sure parent dir exists */
+  for (size_t i = 0; i < ncaps; i++)
   {
-    char dirpath[256];
-    strncpy(dirpath, CONTROL_SOCK, sizeof(dirpath) - 1);
-    dirpath[sizeof(dirpath) - 1] = 0;
-    char *slash = strrchr(dirpath, '/');
-    if (slash)
+    if (caps[i].type == UCAP_PROP)
     {
-      *slash = 0;
-      mkdir(dirpath, 0777);
+      ioctl(out->fd, UI_SET_PROPBIT, caps[i].code);
+      continue;
     }
-  }
 
-  struct sockaddr_un addr;
-  memset(&addr, 0, sizeof(addr));
-  addr.sun_family = AF_UNIX;
-  strncpy(addr.sun_path, CONTROL_SOCK, sizeof(addr.sun_path) - 1);
+    ioctl(out->fd, UI_SET_EVBIT, caps[i].type);
+    ioctl(out->fd, uinput_setbit_req(caps[i].type), caps[i].code);
 
-  unlink(CONTROL_SOCK);
+    if (caps[i].type == EV_ABS)
+    {
+      struct uinput_abs_setup abs;
+      memset(&abs, 0, sizeof(abs));
+      abs.code = caps[i].code;
+      abs.absinfo.maximum = caps[i].max;
+      ioctl(out->fd, UI_ABS_SETUP, &abs);
+      legacy.absmax[caps[i].code] = caps[i].max;
+    }
+  }
 
-  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+  if (uinput_finish(out->fd, name, &id, &legacy) < 0)
   {
-    log_perror("bind(CONTROL_SOCK)");
-    close(fd);
+    close(out->fd);
+    out->fd = -1;
     return -1;
   }
+  return 0;
+#else
+  struct libevdev *tmpl = libevdev_new();
+  if (!tmpl) return -1;
 
-  chmod(CONTROL_SOCK, 0666);
+  libevdev_set_name(tmpl, name);
+  for (size_t i = 0; i < ncaps; i++)
+  {
+    if (caps[i].type == UCAP_PROP)
+    {
+      libevdev_enable_property(tmpl, caps[i].code);
+    }
+    else if (caps[i].type == EV_ABS)
+    {
+      struct input_absinfo abs;
+      memset(&abs, 0, sizeof(abs));
+      abs.maximum = caps[i].max;
+      libevdev_enable_event_code(tmpl, EV_ABS, caps[i].code, &abs);
+    }
+    else
+    {
+      libevdev_enable_event_code(tmpl, caps[i].type, caps[i].code, NULL);
+    }
+  }
 
-  if (listen(fd, 4) < 0)
+  int rc = libevdev_uinput_create_from_device(tmpl, LIBEVDEV_UINPUT_OPEN_MANAGED, &out->uidev);
+  libevdev_free(tmpl);
+  if (rc < 0)
   {
-    log_perror("listen(CONTROL_SOCK)");
-    close(fd);
-    unlink(CONTROL_SOCK);
+    out->uidev = NULL;
     return -1;
   }
-
-  app_state.control_fd = fd;
-  log_message("Control socket listening at %s", CONTROL_SOCK);
   return 0;
+#endif
 }
 
-static void control_cleanup(void)
+/* Whether the device, and so its clone, can send type/code */
+static int input_has_code(const device_t *dev, unsigned int type, unsigned int code)
 {
-  if (app_state.control_fd >= 0)
-  {
-    close(app_state.control_fd);
-    app_state.control_fd = -1;
-  }
-  unlink(CONTROL_SOCK);
+#ifdef RAW_UINPUT
+  unsigned long codes[NLONGS(KEY_CNT)];
+
+  /* Matches what uout_clone() enables */
+  if (type >= EV_CNT || code >= KEY_CNT || type == EV_FF) return 0;
+  if (type != EV_SYN && !uinput_setbit_req(type)) return 0;
+
+  memset(codes, 0, sizeof(codes));
+  if (ioctl(dev->fd, EVIOCGBIT(type, sizeof(codes)), codes) < 0) return 0;
+  return test_bit(code, codes);
+#else
+  return libevdev_has_event_code(dev->evdev, type, code);
+#endif
 }
 
-static void control_handle_command(int client_fd, const char *cmd)
+/* Create a uinput device mirroring the capabilities of a grabbed device */
+static int uout_clone(uout_t *out, const device_t *dev)
 {
-  while (*cmd == ' ' || *cmd == '\n' || *cmd == '\r' || *cmd == '\t')
-    cmd++;
+#ifdef RAW_UINPUT
+  unsigned long evbits[NLONGS(EV_CNT)];
+  unsigned long codes[NLONGS(KEY_CNT)];
+  unsigned long props[NLONGS(INPUT_PROP_CNT)];
+  struct uinput_user_dev legacy;
+  struct input_id id;
+
+  memset(evbits, 0, sizeof(evbits));
+  memset(props, 0, sizeof(props));
+  memset(&legacy, 0, sizeof(legacy));
+  memset(&id, 0, sizeof(id));
+
+  if (ioctl(dev->fd, EVIOCGBIT(0, sizeof(evbits)), evbits) < 0 ||
+      ioctl(dev->fd, EVIOCGID, &id) < 0)
+  {
+    log_perror("ioctl(EVIOCGBIT/EVIOCGID)");
+    return -1;
+  }
 
-  if (strncmp(cmd, "enable", 6) == 0)
+  out->fd = open(DEV_UINPUT, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+  if (out->fd < 0)
   {
-    int was = app_state.mouse.enabled;
-    app_state.mouse.enabled = 1;
-    write_status_file();
-    dprintf(client_fd, "ok enabled\n");
-    on_enabled_transition(was, app_state.mouse.enabled, "socket");
+    log_perror("open(" DEV_UINPUT ")");
+    return -1;
   }
-  else if (strncmp(cmd, "disable", 7) == 0)
+
+  for (unsigned int type = EV_KEY; type < EV_CNT; type++)
   {
-    int was = app_state.mouse.enabled;
-    app_state.mouse.enabled = 0;
-    write_status_file();
-    dprintf(client_fd, "ok disabled\n");
-    on_enabled_transition(was, app_state.mouse.enabled, "socket");
+    if (!test_bit(type, evbits) || type == EV_FF) continue;
+
+    ioctl(out->fd, UI_SET_EVBIT, type);
+
+    unsigned long req = uinput_setbit_req(type);
+    if (!req) continue;
+
+    memset(codes, 0, sizeof(codes));
+    if (ioctl(dev->fd, EVIOCGBIT(type, sizeof(codes)), codes) < 0) continue;
+
+    for (unsigned int code = 0; code < KEY_CNT; code++)
+    {
+      if (!test_bit(code, codes)) continue;
+
+      if (type == EV_ABS)
+      {
+        struct uinput_abs_setup abs;
+        memset(&abs, 0, sizeof(abs));
+        abs.code = code;
+        if (ioctl(dev->fd, EVIOCGABS(code), &abs.absinfo) < 0) continue;
+        ioctl(out->fd, UI_ABS_SETUP, &abs);
+
+        legacy.absmin[code] = abs.absinfo.minimum;
+        legacy.absmax[code] = abs.absinfo.maximum;
+        legacy.absfuzz[code] = abs.absinfo.fuzz;
+        legacy.absflat[code] = abs.absinfo.flat;
+      }
+      ioctl(out->fd, req, code);
+    }
   }
-  else if (strncmp(cmd, "status", 6) == 0)
+
+  if (ioctl(dev->fd, EVIOCGPROP(sizeof(props)), props) >= 0)
   {
-    dprintf(client_fd, "enabled=%d speed=%d drag=%d\n",
-            app_state.mouse.enabled,
-            app_state.mouse.speed,
-            app_state.mouse.drag_mode);
+    for (unsigned int prop = 0; prop < INPUT_PROP_CNT; prop++)
+      if (test_bit(prop, props)) ioctl(out->fd, UI_SET_PROPBIT, prop);
   }
-  else if (strncmp(cmd, "quit", 4) == 0)
+
+  if (uinput_finish(out->fd, dev->name, &id, &legacy) < 0)
   {
-    dprintf(client_fd, "ok quitting\n");
-    log_message("Quit requested (socket)");
-    app_state.running = 0;
+    close(out->fd);
+    out->fd = -1;
+    return -1;
   }
-  else
+  return 0;
+#else
+  if (libevdev_uinput_create_from_device(dev->evdev, LIBEVDEV_UINPUT_OPEN_MANAGED, &out->uidev) < 0)
   {
-    dprintf(client_fd, "err unknown_command\n");
+    out->uidev = NULL;
+    return -1;
   }
+  return 0;
+#endif
 }
 
-static void control_handle_ready(void)
+static void uout_write(const uout_t *out, const struct input_event *evs, size_t n)
 {
-  int cfd = accept(app_state.control_fd, NULL, NULL);
-  if (cfd < 0) return;
-
-  char buf[128];
-  ssize_t n = read(cfd, buf, sizeof(buf) - 1);
-  if (n > 0)
+#ifdef RAW_UINPUT
+  /* One write() per frame; the kernel timestamps each event itself. */
+  if (out->fd < 0) return;
+  if (write(out->fd, evs, n * sizeof(*evs)) < 0)
   {
-    buf[n] = '\0';
-    control_handle_command(cfd, buf);
+    log_perror("write(uinput)");
+    return;
   }
+#else
+  if (!out->uidev) return;
+  for (size_t i = 0; i < n; i++)
+    libevdev_uinput_write_event(out->uidev, evs[i].type, evs[i].code, evs[i].value);
+#endif
 
-  close(cfd);
+  latency_record_frame(evs, n);
 }
 
-static int control_send_cmd(const char *cmd)
+static int uout_fd(const uout_t *out)
 {
-  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
-  if (fd < 0) return 2;
-
-  struct sockaddr_un addr;
-  memset(&addr, 0, sizeof(addr));
-  addr.sun_family = AF_UNIX;
-  strncpy(addr.sun_path, CONTROL_SOCK, sizeof(addr.sun_path) - 1);
+#ifdef RAW_UINPUT
+  return out->fd;
+#else
+  return out->uidev ? libevdev_uinput_get_fd(out->uidev) : -1;
+#endif
+}
 
-  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+static void uout_destroy(uout_t *out)
+{
+#ifdef RAW_UINPUT
+  if (out->fd >= 0)
   {
-    close(fd);
-    return 3;
+    ioctl(out->fd, UI_DEV_DESTROY);
+    close(out->fd);
+    out->fd = -1;
   }
-
-  write(fd, cmd, strlen(cmd));
-  write(fd, "\n", 1);
-
-  char buf[256];
-  ssize_t n = read(fd, buf, sizeof(buf) - 1);
-  if (n > 0)
+#else
+  if (out->uidev)
   {
-    buf[n] = 0;
-    write(STDOUT_FILENO, buf, (size_t)n);
+    libevdev_uinput_destroy(out->uidev);
+    out->uidev = NULL;
   }
-
-  close(fd);
-  return 0;
+#endif
 }
 
-/* --- Mouse Functions --- */
+/* --- Pointer positioning (REL-only) --- */
 
-static int mouse_init(void)
+static void rel_emit(int dx, int dy)
 {
-  app_state.mouse.dev = libevdev_new();
-  log_message("Creating virtual mouse device");
+  struct input_event frame[3];
+  size_t n = 0;
 
-  if (!app_state.mouse.dev)
+  memset(frame, 0, sizeof(frame));
+  if (dx)
   {
-    log_message("ERROR: Failed to create virtual mouse device");
-    return -1;
+    frame[n].type = EV_REL;
+    frame[n].code = REL_X;
+    frame[n++].value = dx;
   }
-
-  libevdev_set_name(app_state.mouse.dev, "FlipMouse Virtual Mouse");
-
-  libevdev_enable_event_code(app_state.mouse.dev, EV_REL, REL_X, NULL);
-  libevdev_enable_event_code(app_state.mouse.dev, EV_REL, REL_Y, NULL);
-  libevdev_enable_event_code(app_state.mouse.dev, EV_REL, REL_WHEEL, NULL);
-  libevdev_enable_event_code(app_state.mouse.dev, EV_REL, REL_HWHEEL, NULL);
-  libevdev_enable_event_code(app_state.mouse.dev, EV_KEY, BTN_LEFT, NULL);
-  libevdev_enable_event_code(app_state.mouse.dev, EV_KEY, BTN_RIGHT, NULL);
-
-  if (libevdev_uinput_create_from_device(app_state.mouse.dev,
-                                         LIBEVDEV_UINPUT_OPEN_MANAGED,
-                                         &app_state.mouse.uidev) < 0)
+  if (dy)
   {
-    log_message("ERROR: Failed to create virtual mouse uinput device");
-    libevdev_free(app_state.mouse.dev);
-    app_state.mouse.dev = NULL;
-    return -1;
+    frame[n].type = EV_REL;
+    frame[n].code = REL_Y;
+    frame[n++].value = dy;
   }
+  frame[n].type = EV_SYN;
+  frame[n++].code = SYN_REPORT;
 
-  app_state.mouse.enabled = 0;
-  app_state.mouse.speed = 4;
-  app_state.mouse.drag_mode = 0;
-  app_state.mouse.toggle_down_at_ms = 0;
+  /* Flush each step so the settle delays below actually pace the output */
+  emit_write(&app_state.mouse.out, frame, n);
+  emit_flush();
+}
 
-  log_message("Virtual mouse initialized successfully");
-  return 0;
+static void park_bottom_right(void)
+{
+  /* Slam down-right enough times to guarantee we hit the BR edge. */
+  for (int i = 0; i < PARK_REPS; i++)
+  {
+    rel_emit(PARK_STEP, PARK_STEP);
+    usleep(CENTER_SETTLE_US);
+  }
+  log_message("Pointer parked bottom-right (REL slam)");
 }
 
-static void mouse_cleanup(void)
+static void move_from_park_to_center(void)
 {
-  if (app_state.mouse.uidev)
+  int left = 40;
+  int up   = 60;
+
+  /* Move X first, then Y. Some stacks do weird things when both axes change together. */
+  while (left > 0)
   {
-    libevdev_uinput_destroy(app_state.mouse.uidev);
-    app_state.mouse.uidev = NULL;
+    int step = (left > CENTER_STEP) ? CENTER_STEP : left;
+    rel_emit(-step, 0);
+    left -= step;
+    usleep(CENTER_SETTLE_US);
   }
 
-  if (app_state.mouse.dev)
+  while (up > 0)
   {
-    libevdev_free(app_state.mouse.dev);
-    app_state.mouse.dev = NULL;
+    int step = (up > CENTER_STEP) ? CENTER_STEP : up;
+    rel_emit(0, -step);
+    up -= step;
+    usleep(CENTER_SETTLE_US);
   }
+}
 
-  log_message("Virtual mouse resources released");
+static void on_enabled_transition(int was_enabled, int now_enabled, const char *why)
+{
+  if (was_enabled == now_enabled) return;
+
+  if (!was_enabled && now_enabled)
+  {
+    /* enabling: re-sync position then go to center */
+    park_bottom_right();
+    move_from_park_to_center();
+    log_message("Mouse enabled (%s)", why);
+  }
+  else if (was_enabled && !now_enabled)
+  {
+    /* disabling: lift any touch, park, and keep what adaptive mode learned */
+    touch_set(0, NULL);
+    park_bottom_right();
+    adaptive_save();
+    log_message("Mouse disabled (%s)", why);
+  }
 }
 
-/* manual toggle via KEY_HELP/KEY_F12 */
-#define TOGGLE_TAP_MAX_MS 400   // tap threshold; tweak 250–600 as desired
+/* --- Adaptive Speed Persistence --- */
 
-static int mouse_toggle(struct input_event *ev)
+static void adaptive_load(void)
 {
-if (ev->value == 1) // key down
-{
-  long long now = ev_time_ms(ev);
+  FILE *fp = fopen(ADAPTIVE_FILE, "r");
+  int gain;
 
-  if (app_state.mouse.toggle_down_at_ms != 0) {
-    log_message("TOGGLE DOWN while already down; resetting (prev=%lldms now=%lldms)",
-                app_state.mouse.toggle_down_at_ms, now);
+  if (!fp) return;
+  if (fscanf(fp, "gain=%d", &gain) == 1)
+  {
+    motion_set_gain(&app_state.motion, gain);
+    log_message("Adaptive gain %d/%d restored", app_state.motion.gain, MOTION_GAIN_ONE);
   }
+  fclose(fp);
+}
 
-  app_state.mouse.toggle_down_at_ms = now;
-  log_message("TOGGLE DOWN code=%d t=%lldms", ev->code, now);
-  return CHANGED_TO_MOUSE;
+/* Only written when the learned gain moved, so no flash wear per event */
+static void adaptive_save(void)
+{
+  if (!app_state.motion.dirty) return;
+
+  int fd = open(ADAPTIVE_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0) return;
+  dprintf(fd, "gain=%d\n", app_state.motion.gain);
+  close(fd);
+
+  app_state.motion.dirty = 0;
+  log_message("Adaptive gain %d/%d saved", app_state.motion.gain, MOTION_GAIN_ONE);
 }
 
-  if (ev->value == 0 && app_state.mouse.toggle_down_at_ms != 0) // key up
+/* --- User Rules --- */
+
+/*
+ * rules_emit_check_t: the virtual mouse, or every clone the rule can fire on.
+ * Runs on the control thread in pipeline mode: the device list is fixed
+ * while the loop runs, grabbed is published atomically by the translator,
+ * and the capability bits come from the kernel or the probe-time evdev.
+ */
+static const char *rules_emit_target(void *ctx, int to_mouse, const char *device, int type, int code)
+{
+  (void)ctx;
+
+  if (to_mouse)
   {
-    long long now = ev_time_ms(ev);
-    long long held = now - app_state.mouse.toggle_down_at_ms;
+    for (size_t i = 0; i < sizeof(mouse_caps) / sizeof(mouse_caps[0]); i++)
+      if (mouse_caps[i].type == type && mouse_caps[i].code == code) return NULL;
+    return type == EV_SYN ? NULL : "the virtual mouse";
+  }
 
-    log_message("TOGGLE UP code=%d t=%lldms held=%lldms", ev->code, now, held);
+  for (device_t *d = app_state.devices; d; d = d->next)
+  {
+    if (!atomic_load(&d->grabbed) || (device && strcmp(d->name, device) != 0)) continue;
+    if (!input_has_code(d, (unsigned)type, (unsigned)code)) return d->name;
+  }
+  return NULL;
+}
 
-    int was = app_state.mouse.enabled;
+/* Compile text, or RULES_FILE when NULL; the loop adopts it on the next event */
+static int rules_reload(const char *text, char *err, size_t errlen)
+{
+  char *buf = NULL;
+  rules_t *r = malloc(sizeof(*r));
 
-    if (held <= TOGGLE_TAP_MAX_MS)
+  if (!r)
+  {
+    snprintf(err, errlen, "out of memory");
+    return -1;
+  }
+
+  if (!text)
+  {
+    FILE *fp = fopen(RULES_FILE, "r");
+    if (!fp)
     {
-      app_state.mouse.enabled = !app_state.mouse.enabled;
-      write_status_file();
-      on_enabled_transition(was, app_state.mouse.enabled, "manual");
-      log_message("TOGGLE TAP accepted -> enabled=%d", app_state.mouse.enabled);
+      snprintf(err, errlen, "cannot open %s: %s", RULES_FILE, strerror(errno));
+      free(r);
+      return -1;
     }
-    else
+
+    buf = malloc(RULES_TEXT_MAX + 1);
+    size_t n = buf ? fread(buf, 1, RULES_TEXT_MAX + 1, fp) : 0;
+    fclose(fp);
+    if (!buf || n > RULES_TEXT_MAX)
     {
-      log_message("TOGGLE ignored (hold too long) held=%lldms", held);
+      snprintf(err, errlen, buf ? "%s larger than %d bytes" : "out of memory",
+               RULES_FILE, RULES_TEXT_MAX);
+      free(buf);
+      free(r);
+      return -1;
     }
+    buf[n] = '\0';
+    text = buf;
+  }
 
-    app_state.mouse.toggle_down_at_ms = 0;
-    return CHANGED_TO_MOUSE;
+  int rc = rules_compile(r, text, rules_emit_target, NULL, err, errlen);
+  free(buf);
+  if (rc < 0)
+  {
+    log_message("ERROR: rules not loaded: %s", err);
+    free(r);
+    return -1;
   }
 
-  return MUTE_EVENT;
+  atomic_store(&app_state.rules.count, (unsigned)r->nrules);
+  atomic_store(&app_state.rules.insns, (unsigned)r->len);
+  atomic_store(&app_state.rules.worst_case, r->worst_case);
+  free(atomic_exchange(&app_state.rules.pending, r));
+
+  log_message("Rules loaded: %zu rules, %zu instructions, worst case %u per event",
+              r->nrules, r->len, r->worst_case);
+  return 0;
 }
 
-static int mouse_handle_event(device_t *dev, struct input_event *ev)
+/* Run the rules for one event; MUTE_EVENT when a rule dropped it */
+static int rules_apply(device_t *dev, struct input_event *ev)
 {
-  static unsigned int slowdown_counter = 0;
-  int keycode = ev->code;
+  rules_state_t *rs = &app_state.rules;
 
-  if (ev->type == EV_MSC)
+  if (atomic_load_explicit(&rs->pending, memory_order_relaxed))
   {
-    if (keycode == MSC_SCAN)
-    {
-      keycode = keymap_get_keycode(ev->value);
-      if (keycode != -1)
-        log_message("Scan code %d mapped to keycode %d", ev->value, keycode);
-    }
+    rules_t *next = atomic_exchange(&rs->pending, NULL);
+    free(rs->active);
+    rs->active = next;
+    for (device_t *d = app_state.devices; d; d = d->next)
+      d->rules_mask = rules_device_mask(next, d->name);
   }
-  else if (ev->type == EV_KEY)
+
+  if (!rs->active || rs->active->nrules == 0)
+    return PASS_THRU_EVENT;
+
+  rules_result_t res;
+  rules_run(rs->active, ev, dev->rules_mask, app_state.mouse.enabled, ev_time_ms(ev), &res);
+
+  for (size_t i = 0; i < res.nemits; i++)
   {
-    if (keymap_get_scanvalue(keycode) != -1)
-    {
-      log_message("Keycode %d handled by MSC_SCAN", keycode);
-      return MUTE_EVENT;
-    }
+    const uout_t *out = res.emits[i].to_mouse ? &app_state.mouse.out : device_output(dev);
+    if (out) emit_event(out, &res.emits[i].ev);
+  }
+
+  if (res.mode != RULES_MODE_KEEP)
+  {
+    int now = res.mode == RULES_MODE_TOGGLE ? !app_state.mouse.enabled
+                                            : res.mode == RULES_MODE_MOUSE;
+    int was = atomic_exchange(&app_state.mouse.enabled, now);
+    if (was != now) write_status_file();
+    on_enabled_transition(was, now, "rule");
+  }
+
+  return res.verdict == RULES_DROP ? MUTE_EVENT : PASS_THRU_EVENT;
+}
+
+/* --- Control Interface (socket) --- */
+
+static int control_init(void)
+{
+  app_state.control_fd = -1;
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+  {
+    log_perror("socket(AF_UNIX)");
+    return -1;
+  }
+
+  /* Make sure parent dir exists */
+  {
+    char dirpath[256];
+    strncpy(dirpath, CONTROL_SOCK, sizeof(dirpath) - 1);
+    dirpath[sizeof(dirpath) - 1] = 0;
+    char *slash = strrchr(dirpath, '/');
+    if (slash)
+    {
+      *slash = 0;
+      mkdir(dirpath, 0777);
+    }
+  }
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, CONTROL_SOCK, sizeof(addr.sun_path) - 1);
+
+  unlink(CONTROL_SOCK);
+
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+  {
+    log_perror("bind(CONTROL_SOCK)");
+    close(fd);
+    return -1;
+  }
+
+  chmod(CONTROL_SOCK, 0666);
+
+  /* Non-blocking so control_handle_ready() can drain the backlog */
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+  if (listen(fd, CONTROL_BACKLOG) < 0)
+  {
+    log_perror("listen(CONTROL_SOCK)");
+    close(fd);
+    unlink(CONTROL_SOCK);
+    return -1;
+  }
+
+  app_state.control_fd = fd;
+  log_message("Control socket listening at %s", CONTROL_SOCK);
+  return 0;
+}
+
+static void control_cleanup(void)
+{
+  for (size_t i = 0; i < app_state.nclients; i++) close(app_state.clients[i].fd);
+  app_state.nclients = 0;
+
+  if (app_state.control_fd >= 0)
+  {
+    close(app_state.control_fd);
+    app_state.control_fd = -1;
+  }
+  unlink(CONTROL_SOCK);
+}
+
+static void control_handle_command(int client_fd, const char *cmd)
+{
+  while (*cmd == ' ' || *cmd == '\n' || *cmd == '\r' || *cmd == '\t')
+    cmd++;
+
+  if (strncmp(cmd, "enable", 6) == 0)
+  {
+    int was = atomic_exchange(&app_state.mouse.enabled, 1);
+    dprintf(client_fd, "ok enabled\n");
+    translator_post(TRANSLATOR_MODE, was, 1);
+  }
+  else if (strncmp(cmd, "disable", 7) == 0)
+  {
+    int was = atomic_exchange(&app_state.mouse.enabled, 0);
+    dprintf(client_fd, "ok disabled\n");
+    translator_post(TRANSLATOR_MODE, was, 0);
+  }
+  else if (strncmp(cmd, "status", 6) == 0)
+  {
+    dprintf(client_fd, "enabled=%d speed=%d drag=%d loop=%s adaptive=%d output=%s\n",
+            app_state.mouse.enabled,
+            app_state.mouse.speed,
+            app_state.mouse.drag_mode,
+            app_state.loop->name,
+            app_state.mouse.adaptive,
+            app_state.mouse.output == OUTPUT_TOUCH ? "touch" : "pointer");
+  }
+  else if (strncmp(cmd, "output touch", 12) == 0)
+  {
+    if (touch_init() == 0)
+    {
+      atomic_store(&app_state.mouse.output, OUTPUT_TOUCH);
+      dprintf(client_fd, "ok output=touch\n");
+    }
+    else
+    {
+      dprintf(client_fd, "err touch_unavailable\n");
+    }
+  }
+  else if (strncmp(cmd, "output pointer", 14) == 0)
+  {
+    atomic_store(&app_state.mouse.output, OUTPUT_POINTER);
+    dprintf(client_fd, "ok output=pointer\n");
+  }
+  else if (strncmp(cmd, "output", 6) == 0)
+  {
+    dprintf(client_fd, "output=%s x=%d y=%d screen=%dx%d scale=%d%%\n",
+            app_state.mouse.output == OUTPUT_TOUCH ? "touch" : "pointer",
+            atomic_load(&app_state.mouse.x),
+            atomic_load(&app_state.mouse.y),
+            app_state.mouse.screen_w, app_state.mouse.screen_h,
+            app_state.mouse.scale_pct);
+  }
+  else if (strncmp(cmd, "adaptive on", 11) == 0 || strncmp(cmd, "adaptive off", 12) == 0)
+  {
+    int on = cmd[10] == 'n';
+    atomic_store(&app_state.mouse.adaptive, on);
+    if (!on) translator_post(TRANSLATOR_ADAPTIVE_SAVE, 0, 0);
+    dprintf(client_fd, "ok adaptive=%d\n", on);
+  }
+  else if (strncmp(cmd, "adaptive", 8) == 0)
+  {
+    dprintf(client_fd, "adaptive=%d gain=%d/%d overshoots=%u long_runs=%u\n",
+            atomic_load(&app_state.mouse.adaptive),
+            atomic_load(&app_state.mouse.gain), MOTION_GAIN_ONE,
+            atomic_load(&app_state.mouse.overshoots),
+            atomic_load(&app_state.mouse.long_runs));
+  }
+  else if (strncmp(cmd, "stats reset", 11) == 0)
+  {
+    latency_reset();
+    overload_reset();
+    perf_reset();
+    dprintf(client_fd, "ok stats_reset\n");
+  }
+  else if (strncmp(cmd, "stats", 5) == 0)
+  {
+    dprintf(client_fd, "loop=%s frames=%u p50_us=%u p90_us=%u p99_us=%u max_us=%u "
+            "overload_batches=%u shed_repeats=%u merged_rel=%u syn_dropped=%u resyncs=%u\n",
+            app_state.loop->name,
+            atomic_load(&app_state.latency.count),
+            latency_percentile(50),
+            latency_percentile(90),
+            latency_percentile(99),
+            atomic_load(&app_state.latency.max_us),
+            atomic_load(&app_state.overload.batches),
+            atomic_load(&app_state.overload.shed),
+            atomic_load(&app_state.overload.merged),
+            atomic_load(&app_state.overload.syn_dropped),
+            atomic_load(&app_state.overload.resyncs));
+    if (atomic_load(&app_state.perf.enabled)) perf_report(client_fd);
+  }
+  else if (strncmp(cmd, "perf on", 7) == 0 || strncmp(cmd, "perf off", 8) == 0)
+  {
+    int on = cmd[6] == 'n';
+    atomic_store(&app_state.perf.enabled, on);
+    dprintf(client_fd, "ok perf=%d\n", on);
+  }
+  else if (strncmp(cmd, "perf", 4) == 0)
+  {
+    dprintf(client_fd, "perf=%d\n", atomic_load(&app_state.perf.enabled));
+    perf_report(client_fd);
+  }
+  else if (strncmp(cmd, "rules reload", 12) == 0 || strncmp(cmd, "rules clear", 11) == 0)
+  {
+    char err[160];
+    if (rules_reload(cmd[6] == 'c' ? "" : NULL, err, sizeof(err)) == 0)
+      dprintf(client_fd, "ok rules=%u worst_case=%u\n",
+              atomic_load(&app_state.rules.count),
+              atomic_load(&app_state.rules.worst_case));
+    else
+      dprintf(client_fd, "err %s\n", err);
+  }
+  else if (strncmp(cmd, "rules", 5) == 0)
+  {
+    dprintf(client_fd, "rules=%u insns=%u worst_case=%u max_insns=%d\n",
+            atomic_load(&app_state.rules.count),
+            atomic_load(&app_state.rules.insns),
+            atomic_load(&app_state.rules.worst_case),
+            RULES_MAX_INSNS);
+  }
+  else if (strncmp(cmd, "startup-report", 14) == 0)
+  {
+    startup_report(client_fd);
+  }
+  else if (strncmp(cmd, "quit", 4) == 0)
+  {
+    dprintf(client_fd, "ok quitting\n");
+    log_message("Quit requested (socket)");
+    app_state.running = 0;
+  }
+  else
+  {
+    dprintf(client_fd, "err unknown_command\n");
+  }
+}
+
+/*
+ * Accept every queued connection (the io_uring poll is edge triggered).
+ * Clients are non-blocking: each is answered once its command has
+ * arrived, and one that connects but never writes is dropped after
+ * CONTROL_CLIENT_TIMEOUT_MS without ever blocking the loop.
+ */
+static void control_handle_ready(void)
+{
+  for (;;)
+  {
+    int cfd = accept(app_state.control_fd, NULL, NULL);
+    if (cfd < 0) break;
+
+    fcntl(cfd, F_SETFL, fcntl(cfd, F_GETFL) | O_NONBLOCK);
+    fcntl(cfd, F_SETFD, FD_CLOEXEC);
+
+    if (app_state.nclients == CONTROL_CLIENTS_MAX)
+    {
+      dprintf(cfd, "err busy\n");
+      close(cfd);
+      continue;
+    }
+
+    app_state.clients[app_state.nclients].fd = cfd;
+    app_state.clients[app_state.nclients].accepted_us = mono_us();
+    app_state.nclients++;
+    if (app_state.loop->watch_client) app_state.loop->watch_client(cfd);
+  }
+
+  control_serve_clients();
+}
+
+/* Answer clients whose command has arrived; drop those that timed out */
+static void control_serve_clients(void)
+{
+  long long now = mono_us();
+  size_t keep = 0;
+
+  for (size_t i = 0; i < app_state.nclients; i++)
+  {
+    control_client_t c = app_state.clients[i];
+    char buf[128];
+    ssize_t n = read(c.fd, buf, sizeof(buf) - 1);
+
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) &&
+        now - c.accepted_us < CONTROL_CLIENT_TIMEOUT_MS * 1000LL)
+    {
+      app_state.clients[keep++] = c;
+      continue;
+    }
+
+    if (n > 0)
+    {
+      perf_sample_t perf;
+      perf_begin(&perf);
+      buf[n] = '\0';
+      control_handle_command(c.fd, buf);
+      perf_end(&perf, PERF_PATH_CONTROL);
+    }
+
+    /* An io_uring poll may still hold the socket; make the hangup immediate */
+    shutdown(c.fd, SHUT_RDWR);
+    close(c.fd);
+  }
+
+  app_state.nclients = keep;
+}
+
+/* Add waiting clients to a select() set; returns the new nfds */
+static int control_fdset(fd_set *set, int maxfd)
+{
+  for (size_t i = 0; i < app_state.nclients; i++)
+  {
+    FD_SET(app_state.clients[i].fd, set);
+    if (app_state.clients[i].fd >= maxfd) maxfd = app_state.clients[i].fd + 1;
+  }
+  return maxfd;
+}
+
+static int control_send_cmd(const char *cmd)
+{
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return 2;
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, CONTROL_SOCK, sizeof(addr.sun_path) - 1);
+
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+  {
+    close(fd);
+    return 3;
+  }
+
+  write(fd, cmd, strlen(cmd));
+  write(fd, "\n", 1);
+
+  /* Replies can span several reads (startup-report); read until EOF */
+  char buf[256];
+  ssize_t n;
+  while ((n = read(fd, buf, sizeof(buf))) > 0)
+    write(STDOUT_FILENO, buf, (size_t)n);
+
+  close(fd);
+  return 0;
+}
+
+/* --- Mouse Functions --- */
+
+static void *mouse_create_thread(void *arg)
+{
+  long long t = mono_us();
+  (void)arg;
+  app_state.mouse.create_rc =
+      uout_create(&app_state.mouse.out, "FlipMouse Virtual Mouse",
+                  mouse_caps, sizeof(mouse_caps) / sizeof(mouse_caps[0]));
+  startup_phase("uinput", "mouse", t);
+  return NULL;
+}
+
+/* Start creating the virtual mouse; it overlaps the device scan */
+static int mouse_init(void)
+{
+  log_message("Creating virtual mouse device");
+
+  app_state.mouse.enabled = 0;
+  motion_publish();
+  app_state.mouse.drag_mode = 0;
+  app_state.mouse.toggle_down_at_ms = 0;
+
+  /* Start the estimate mid-screen; parking pins it to the corner anyway */
+  app_state.mouse.x100 = (long)app_state.mouse.screen_w * 50;
+  app_state.mouse.y100 = (long)app_state.mouse.screen_h * 50;
+  app_state.mouse.x = app_state.mouse.screen_w / 2;
+  app_state.mouse.y = app_state.mouse.screen_h / 2;
+
+  uout_reset(&app_state.mouse.out);
+  uout_reset(&app_state.mouse.touch);
+  if (pthread_create(&app_state.mouse.create_thread, NULL, mouse_create_thread, NULL) == 0)
+  {
+    app_state.mouse.create_pending = 1;
+    return 0;
+  }
+
+  mouse_create_thread(NULL);
+  return mouse_wait_ready();
+}
+
+static int mouse_wait_ready(void)
+{
+  if (app_state.mouse.create_pending)
+  {
+    pthread_join(app_state.mouse.create_thread, NULL);
+    app_state.mouse.create_pending = 0;
+  }
+
+  if (app_state.mouse.create_rc < 0)
+  {
+    log_message("ERROR: Failed to create virtual mouse uinput device");
+    return -1;
+  }
+
+  log_message("Virtual mouse initialized successfully");
+  return 0;
+}
+
+static void mouse_cleanup(void)
+{
+  if (app_state.mouse.create_pending)
+  {
+    pthread_join(app_state.mouse.create_thread, NULL);
+    app_state.mouse.create_pending = 0;
+  }
+  uout_destroy(&app_state.mouse.out);
+  uout_destroy(&app_state.mouse.touch);
+
+  log_message("Virtual mouse resources released");
+}
+
+/* manual toggle via KEY_HELP/KEY_F12 */
+#define TOGGLE_TAP_MAX_MS 400   // tap threshold; tweak 250–600 as desired
+
+static int mouse_toggle(struct input_event *ev)
+{
+if (ev->value == 1) // key down
+{
+  long long now = ev_time_ms(ev);
+
+  if (app_state.mouse.toggle_down_at_ms != 0) {
+    log_message("TOGGLE DOWN while already down; resetting (prev=%lldms now=%lldms)",
+                app_state.mouse.toggle_down_at_ms, now);
+  }
+
+  app_state.mouse.toggle_down_at_ms = now;
+  log_message("TOGGLE DOWN code=%d t=%lldms", ev->code, now);
+  return CHANGED_TO_MOUSE;
+}
+
+  if (ev->value == 0 && app_state.mouse.toggle_down_at_ms != 0) // key up
+  {
+    long long now = ev_time_ms(ev);
+    long long held = now - app_state.mouse.toggle_down_at_ms;
+
+    log_message("TOGGLE UP code=%d t=%lldms held=%lldms", ev->code, now, held);
+
+    if (held <= TOGGLE_TAP_MAX_MS)
+    {
+      int was = atomic_fetch_xor(&app_state.mouse.enabled, 1);
+      write_status_file();
+      on_enabled_transition(was, !was, "manual");
+      log_message("TOGGLE TAP accepted -> enabled=%d", app_state.mouse.enabled);
+    }
+    else
+    {
+      log_message("TOGGLE ignored (hold too long) held=%lldms", held);
+    }
+
+    app_state.mouse.toggle_down_at_ms = 0;
+    return CHANGED_TO_MOUSE;
+  }
+
+  return MUTE_EVENT;
+}
+
+/* Copy what the control thread reports out of the translator-owned motion state */
+static void motion_publish(void)
+{
+  const motion_t *m = &app_state.motion;
+
+  atomic_store_explicit(&app_state.mouse.speed, motion_base_speed(m), memory_order_relaxed);
+  atomic_store_explicit(&app_state.mouse.gain, m->gain, memory_order_relaxed);
+  atomic_store_explicit(&app_state.mouse.overshoots, m->overshoots, memory_order_relaxed);
+  atomic_store_explicit(&app_state.mouse.long_runs, m->long_runs, memory_order_relaxed);
+}
+
+/* Step for one arrow event; publishes the effective speed for status */
+static int mouse_motion_step(motion_dir_t dir, const struct input_event *ev)
+{
+  motion_t *m = &app_state.motion;
+
+  m->adaptive = atomic_load_explicit(&app_state.mouse.adaptive, memory_order_relaxed);
+  int step = motion_step(m, dir, ev_time_ms(ev));
+  motion_publish();
+  return step;
+}
+
+static int mouse_handle_event(device_t *dev, struct input_event *ev)
+{
+  static unsigned int slowdown_counter = 0;
+  int keycode = ev->code;
+
+  if (ev->type == EV_MSC)
+  {
+    if (keycode == MSC_SCAN)
+    {
+      keycode = keymap_get_keycode(ev->value);
+      if (keycode != -1)
+        log_message("Scan code %d mapped to keycode %d", ev->value, keycode);
+    }
+  }
+  else if (ev->type == EV_KEY)
+  {
+    if (keymap_get_scanvalue(keycode) != -1)
+    {
+      log_message("Keycode %d handled by MSC_SCAN", keycode);
+      return MUTE_EVENT;
+    }
   }
 
   switch (keycode)
   {
-  case KEY_ENTER:
-    log_message("Mouse left click");
-    ev->type = EV_KEY;
-    ev->code = BTN_LEFT;
-    return CHANGED_TO_MOUSE;
+  case KEY_ENTER:
+    /* Touch mode taps at the cursor estimate; a release follows its press */
+    if (ev->value == 1 ? app_state.mouse.output == OUTPUT_TOUCH : app_state.mouse.touch_down)
+    {
+      if (ev->value != 2) touch_set(ev->value, ev);
+      return MUTE_EVENT;
+    }
+
+    log_message("Mouse left click");
+    ev->type = EV_KEY;
+    ev->code = BTN_LEFT;
+    return CHANGED_TO_MOUSE;
+
+  case KEY_B:
+    if (ev->value == 1)
+    {
+      app_state.mouse.drag_mode = !app_state.mouse.drag_mode;
+      log_message("Drag mode %s", app_state.mouse.drag_mode ? "enabled" : "disabled");
+
+      if (app_state.mouse.drag_mode ? app_state.mouse.output == OUTPUT_TOUCH : app_state.mouse.touch_down)
+      {
+        touch_set(app_state.mouse.drag_mode, ev);
+        return MUTE_EVENT;
+      }
+
+      ev->type = EV_KEY;
+      ev->code = BTN_LEFT;
+      ev->value = app_state.mouse.drag_mode ? 1 : 0;
+      return CHANGED_TO_MOUSE;
+    }
+    break;
+
+  case KEY_UP:
+    ev->type = EV_REL;
+    ev->code = REL_Y;
+    ev->value = -mouse_motion_step(MOTION_UP, ev);
+    return CHANGED_TO_MOUSE;
+
+  case KEY_DOWN:
+    ev->type = EV_REL;
+    ev->code = REL_Y;
+    ev->value = mouse_motion_step(MOTION_DOWN, ev);
+    return CHANGED_TO_MOUSE;
+
+  case KEY_LEFT:
+    ev->type = EV_REL;
+    ev->code = REL_X;
+    ev->value = -mouse_motion_step(MOTION_LEFT, ev);
+    return CHANGED_TO_MOUSE;
+
+  case KEY_RIGHT:
+    ev->type = EV_REL;
+    ev->code = REL_X;
+    ev->value = mouse_motion_step(MOTION_RIGHT, ev);
+    return CHANGED_TO_MOUSE;
+
+  case KEY_MENU:
+    if (slowdown_counter++ % WHEEL_SLOWDOWN_FACTOR)
+      return MUTE_EVENT;
+
+    ev->type = EV_REL;
+    ev->code = REL_WHEEL;
+    ev->value = 1;
+    return CHANGED_TO_MOUSE;
+
+  case KEY_SEND:
+    if (slowdown_counter++ % WHEEL_SLOWDOWN_FACTOR)
+      return MUTE_EVENT;
+
+    ev->type = EV_REL;
+    ev->code = REL_WHEEL;
+    ev->value = -1;
+    return CHANGED_TO_MOUSE;
+
+  default:
+    return PASS_THRU_EVENT;
+  }
+
+  return PASS_THRU_EVENT;
+}
+
+/* --- Cursor Estimate and Direct Touch --- */
+
+/*
+ * Android scales REL motion by its pointer speed, so the estimate applies
+ * --pointer-scale and clamps to the screen like the real pointer does.
+ * Parking slams it into the bottom-right corner, which re-anchors it.
+ *
+ * In touch mode the pointer still moves (it shows where a tap will land),
+ * but KEY_ENTER and drag mode drive a single-finger INPUT_PROP_DIRECT
+ * touchscreen instead of BTN_LEFT, at the estimated position.
+ */
+
+static int touch_init(void)
+{
+  mouse_t *m = &app_state.mouse;
+  const ucap_t caps[] = {
+      {EV_KEY, BTN_TOUCH, 0},
+      {EV_ABS, ABS_MT_SLOT, 0},
+      {EV_ABS, ABS_MT_TRACKING_ID, 0xffff},
+      {EV_ABS, ABS_MT_POSITION_X, m->screen_w - 1},
+      {EV_ABS, ABS_MT_POSITION_Y, m->screen_h - 1},
+      {UCAP_PROP, INPUT_PROP_DIRECT, 0}};
+
+  if (atomic_load(&m->touch_ready)) return 0;
+
+  log_message("Creating virtual touchscreen %dx%d", m->screen_w, m->screen_h);
+  if (uout_create(&m->touch, "FlipMouse Virtual Touch", caps, sizeof(caps) / sizeof(caps[0])) < 0)
+  {
+    log_message("ERROR: Failed to create virtual touchscreen");
+    return -1;
+  }
+
+  atomic_store(&m->touch_ready, 1);
+  return 0;
+}
+
+static void touch_ev(struct input_event *ev, unsigned short type, unsigned short code, int value)
+{
+  ev->type = type;
+  ev->code = code;
+  ev->value = value;
+}
+
+/* Finger down at the cursor estimate, or up; src carries the timestamp. Translator only. */
+static void touch_set(int down, const struct input_event *src)
+{
+  mouse_t *m = &app_state.mouse;
+  struct input_event frame[5];
+  size_t n = 0;
+
+  if (!atomic_load(&m->touch_ready) || down == m->touch_down) return;
+
+  memset(frame, 0, sizeof(frame));
+  if (down)
+  {
+    m->touch_id = (m->touch_id + 1) & 0xffff;
+    touch_ev(&frame[n++], EV_ABS, ABS_MT_TRACKING_ID, m->touch_id);
+    touch_ev(&frame[n++], EV_ABS, ABS_MT_POSITION_X, m->x);
+    touch_ev(&frame[n++], EV_ABS, ABS_MT_POSITION_Y, m->y);
+    touch_ev(&frame[n++], EV_KEY, BTN_TOUCH, 1);
+  }
+  else
+  {
+    touch_ev(&frame[n++], EV_ABS, ABS_MT_TRACKING_ID, -1);
+    touch_ev(&frame[n++], EV_KEY, BTN_TOUCH, 0);
+  }
+  touch_ev(&frame[n++], EV_SYN, SYN_REPORT, 0);
+
+  if (src)
+  {
+    frame[0].input_event_sec = src->input_event_sec;
+    frame[0].input_event_usec = src->input_event_usec;
+  }
+
+  log_message("Touch %s at %d,%d", down ? "down" : "up", m->x, m->y);
+  m->touch_down = down;
+  emit_write(&m->touch, frame, n);
+}
+
+/* Follows REL frames written to the virtual mouse; drags a held touch along. Translator only. */
+static void cursor_track(const struct input_event *evs, size_t n)
+{
+  mouse_t *m = &app_state.mouse;
+  int moved = 0;
+
+  for (size_t i = 0; i < n; i++)
+  {
+    if (evs[i].type != EV_REL) continue;
+
+    if (evs[i].code == REL_X)
+    {
+      m->x100 += (long)evs[i].value * m->scale_pct;
+      moved = 1;
+    }
+    else if (evs[i].code == REL_Y)
+    {
+      m->y100 += (long)evs[i].value * m->scale_pct;
+      moved = 1;
+    }
+  }
+
+  if (!moved) return;
+
+  long max_x = (long)(m->screen_w - 1) * 100;
+  long max_y = (long)(m->screen_h - 1) * 100;
+  m->x100 = m->x100 < 0 ? 0 : (m->x100 > max_x ? max_x : m->x100);
+  m->y100 = m->y100 < 0 ? 0 : (m->y100 > max_y ? max_y : m->y100);
+  atomic_store_explicit(&m->x, (int)(m->x100 / 100), memory_order_relaxed);
+  atomic_store_explicit(&m->y, (int)(m->y100 / 100), memory_order_relaxed);
+
+  if (!m->touch_down) return;
+
+  struct input_event frame[3];
+  memset(frame, 0, sizeof(frame));
+  frame[0] = evs[0];
+  touch_ev(&frame[0], EV_ABS, ABS_MT_POSITION_X, m->x);
+  touch_ev(&frame[1], EV_ABS, ABS_MT_POSITION_Y, m->y);
+  touch_ev(&frame[2], EV_SYN, SYN_REPORT, 0);
+  emit_write(&m->touch, frame, 3);
+}
+
+/* --- Device Management Functions --- */
+
+static int devices_find_and_init(void)
+{
+  DIR *dir;
+  struct dirent *file;
+  int result = -1;
+  long long t_scan = mono_us();
+  /* One node per /dev/input entry; summed so they cannot crowd out later phases */
+  long long t_probes = 0, probe_us = 0;
+  unsigned nprobes = 0;
+
+  dir = opendir(DEV_INPUT);
+  if (!dir)
+  {
+    log_message("ERROR: Failed to open directory %s", DEV_INPUT);
+    log_perror("opendir");
+    return -1;
+  }
+
+  while ((file = readdir(dir)) != NULL)
+  {
+    char file_path[256];
+    int found = 0;
+
+    if (file->d_type != DT_CHR)
+      continue;
+
+    snprintf(file_path, sizeof(file_path), "%s/%s", DEV_INPUT, file->d_name);
+    log_message("Checking device %s", file_path);
+
+    long long t_probe = mono_us();
+    device_t *dev = (device_t *)calloc(1, sizeof(device_t));
+    if (!dev)
+    {
+      log_message("ERROR: Failed to allocate memory for device");
+      continue;
+    }
+    uout_reset(&dev->out);
+
+    dev->fd = open(file_path, O_RDONLY | O_CLOEXEC);
+    if (dev->fd < 0)
+    {
+      log_message("ERROR: Failed to open device file %s", file_path);
+      log_perror("open");
+      free(dev);
+      continue;
+    }
+
+    if (input_probe(dev) < 0)
+    {
+      log_message("ERROR: Failed to probe device fd %d", dev->fd);
+      device_free(dev);
+      continue;
+    }
+    if (!nprobes++) t_probes = t_probe;
+    probe_us += mono_us() - t_probe;
+
+    for (int i = 0; supported_devices[i]; i++)
+    {
+      if (strcmp(dev->name, supported_devices[i]) == 0)
+      {
+        log_message("Found supported device: %s", dev->name);
+
+        long long t_grab = mono_us();
+        dev->grabbed = ioctl(dev->fd, EVIOCGRAB, 1) == 0;
+        if (!dev->grabbed)
+          log_message("WARNING: Failed to grab device exclusively; not cloning it");
+        startup_phase("grab", file->d_name, t_grab);
+
+        /* Timestamps comparable with mono_us() for latency stats */
+        int clk = CLOCK_MONOTONIC;
+        if (ioctl(dev->fd, EVIOCSCLOCKID, &clk) < 0)
+          log_message("WARNING: Failed to set device clock");
+
+        log_message("Successfully attached device: %s", dev->name);
+
+        if (i == 2)
+        {
+          log_message("Using laptop keymap");
+          app_state.keymap = laptop_keymap;
+          app_state.keymap_size = sizeof(laptop_keymap) / sizeof(laptop_keymap[0]);
+        }
+        else if (i < 2 || !app_state.keymap)
+        {
+          /* Keypad keymap; the bench keyboard keeps a real keyboard's keymap */
+          app_state.keymap = keypad_keymap;
+          app_state.keymap_size = sizeof(keypad_keymap) / sizeof(keypad_keymap[0]);
+        }
+
+        if (!app_state.devices)
+        {
+          app_state.devices = dev;
+        }
+        else
+        {
+          device_t *d = app_state.devices;
+          while (d->next) d = d->next;
+          d->next = dev;
+        }
+
+        found = 1;
+        result = 0;
+        break;
+      }
+    }
+
+    if (!found)
+    {
+      log_message("Device %s not in supported list", file_path);
+      device_free(dev);
+    }
+  }
+
+  closedir(dir);
+  if (nprobes) startup_phase_sum("probe", nprobes, t_probes, probe_us);
+  startup_phase("scan", NULL, t_scan);
+
+  /*
+   * Clone after the scan so the new nodes (which carry the same names)
+   * cannot be picked up by it. Creation runs in the background; the loop
+   * only waits for a clone when it first passes an event through it.
+   */
+  for (device_t *d = app_state.devices; d; d = d->next)
+    device_start_clone(d);
+
+  return result;
+}
+
+static void *device_clone_thread(void *arg)
+{
+  device_t *dev = (device_t *)arg;
+  long long t = mono_us();
+  dev->clone_rc = uout_clone(&dev->out, dev);
+  startup_phase("uinput", dev->name, t);
+  return NULL;
+}
+
+static void device_start_clone(device_t *dev)
+{
+  if (!dev->grabbed) return;
+
+  if (pthread_create(&dev->clone_thread, NULL, device_clone_thread, dev) == 0)
+  {
+    dev->clone_state = CLONE_PENDING;
+    return;
+  }
+
+  device_clone_thread(dev);
+  dev->clone_state = dev->clone_rc < 0 ? CLONE_FAILED : CLONE_READY;
+}
+
+/*
+ * Pass-through target for a device, or NULL if events should not be
+ * forwarded. Only the translating thread calls this.
+ */
+static const uout_t *device_output(device_t *dev)
+{
+  if (dev->clone_state == CLONE_PENDING)
+  {
+    pthread_join(dev->clone_thread, NULL);
+    dev->clone_state = dev->clone_rc < 0 ? CLONE_FAILED : CLONE_READY;
+
+    if (dev->clone_state == CLONE_FAILED)
+    {
+      /* Hand the device back to the system rather than swallow its keys */
+      log_message("ERROR: Failed to create uinput device for %s; releasing grab", dev->name);
+      ioctl(dev->fd, EVIOCGRAB, 0);
+      dev->grabbed = 0;
+    }
+  }
+
+  return dev->clone_state == CLONE_READY ? &dev->out : NULL;
+}
+
+static void device_free(device_t *dev)
+{
+  if (dev->clone_state == CLONE_PENDING) pthread_join(dev->clone_thread, NULL);
+  uout_destroy(&dev->out);
+#ifndef RAW_UINPUT
+  if (dev->evdev) libevdev_free(dev->evdev);
+#endif
+  if (dev->fd >= 0) close(dev->fd);
+  free(dev);
+}
+
+static void devices_cleanup(void)
+{
+  device_t *curr = app_state.devices;
+
+  while (curr)
+  {
+    device_t *next = curr->next;
+    device_free(curr);
+    curr = next;
+  }
+
+  app_state.devices = NULL;
+  log_message("All input devices released");
+}
+
+/* --- Event Handling Functions --- */
+
+static int handle_input_event(device_t *dev, struct input_event *ev)
+{
+  if (ev->type == EV_KEY)
+  {
+    if (ev->code == KEY_HELP || ev->code == KEY_F12 || ev->code == KEY_FOCUS)
+    {
+      log_message("EV_KEY toggle candidate code=%d value=%d enabled=%d t=%ld.%06ld",
+                  ev->code, ev->value, app_state.mouse.enabled,
+                  (long)ev->input_event_sec, (long)ev->input_event_usec);
+      return mouse_toggle(ev);
+    }
+  }
+
+  /* Rules see everything but the toggle keys, so a rule cannot lock them out */
+  if (rules_apply(dev, ev) == MUTE_EVENT)
+    return MUTE_EVENT;
+
+  if (!app_state.mouse.enabled)
+    return PASS_THRU_EVENT;
+
+  return mouse_handle_event(dev, ev);
+}
+
+/* --- Signal Handling --- */
+
+static void signal_handler(int sig)
+{
+  log_message("Received signal %d, shutting down", sig);
+  app_state.running = 0;
+}
+
+static void setup_signal_handlers(void)
+{
+  signal(SIGINT, signal_handler);
+  signal(SIGTERM, signal_handler);
+  signal(SIGHUP, signal_handler);
+  signal(SIGPIPE, SIG_IGN); /* control clients may hang up before their reply */
+}
+
+/* --- Main Event Loop --- */
+
+/* Translating thread only: the cursor estimate follows every mouse frame */
+static void emit_write(const uout_t *out, const struct input_event *evs, size_t n)
+{
+  app_state.loop->write(out, evs, n);
+  if (out == &app_state.mouse.out) cursor_track(evs, n);
+}
+
+static void emit_flush(void)
+{
+  if (app_state.loop->flush) app_state.loop->flush();
+}
+
+/* Queue a single event followed by SYN_REPORT; keeps the source timestamp */
+static void emit_event(const uout_t *out, const struct input_event *ev)
+{
+  struct input_event frame[2];
+  frame[0] = *ev;
+  memset(&frame[1], 0, sizeof(frame[1]));
+  frame[1].type = EV_SYN;
+  frame[1].code = SYN_REPORT;
+  emit_write(out, frame, 2);
+}
+
+/* Translate and forward one event; REL output is merged when merge is set */
+static void process_event(device_t *d, struct input_event *event, rel_merge_t *merge)
+{
+#ifdef DEBUG
+  char prefix[8];
+  snprintf(prefix, sizeof(prefix), "<%d<", d->fd);
+  log_event(prefix, event);
+#endif
+
+  perf_sample_t perf;
+  perf_path_t path = app_state.mouse.enabled ? PERF_PATH_MOUSE : PERF_PATH_PASS;
+
+  if (event->type == EV_KEY &&
+      (event->code == KEY_HELP || event->code == KEY_F12 || event->code == KEY_FOCUS))
+    path = PERF_PATH_TOGGLE;
+
+  perf_begin(&perf);
+
+  int event_result = handle_input_event(d, event);
+
+  if (event_result > 0)
+  {
+    const uout_t *out = device_output(d);
+    if (out)
+    {
+#ifdef DEBUG
+      snprintf(prefix, sizeof(prefix), ">%d>", d->fd);
+      log_event(prefix, event);
+#endif
+      emit_event(out, event);
+    }
+    if (path == PERF_PATH_MOUSE) path = PERF_PATH_PASS; /* not a mouse key */
+  }
+  else if (event_result < 0)
+  {
+#ifdef DEBUG
+    log_event(">M>", event);
+#endif
+    if (merge && event->type == EV_REL)
+    {
+      rel_merge_add(merge, event);
+    }
+    else
+    {
+      /* Buttons stay ordered after the motion before them */
+      if (merge) rel_merge_flush(merge);
+      emit_event(&app_state.mouse.out, event);
+    }
+  }
+
+  perf_end(&perf, path);
+}
+
+/* Translate and forward a batch of events read from one device */
+static void process_events(device_t *d, struct input_event *evs, size_t n)
+{
+  rel_merge_t merge;
+  int overloaded = overload_check(d, evs, n);
+  int frame_start = 1;
+
+  memset(&merge, 0, sizeof(merge));
+
+  for (size_t i = 0; i < n; i++)
+  {
+    struct input_event *event = &evs[i];
+
+    /* The kernel buffer overflowed: drop the partial frame, then resync */
+    if (event->type == EV_SYN && event->code == SYN_DROPPED)
+    {
+      atomic_fetch_add_explicit(&app_state.overload.syn_dropped, 1, memory_order_relaxed);
+      d->syn_dropped = 1;
+      continue;
+    }
+
+    if (d->syn_dropped)
+    {
+      if (event->type == EV_SYN && event->code == SYN_REPORT)
+      {
+        d->syn_dropped = 0;
+        device_resync_keys(d);
+        frame_start = 1;
+      }
+      continue;
+    }
+
+    /* Autorepeat carries no new state; shed whole repeat frames */
+    if (overloaded && frame_start)
+    {
+      size_t end = frame_repeat_end(evs, n, i);
+      if (end > i)
+      {
+        atomic_fetch_add_explicit(&app_state.overload.shed, 1, memory_order_relaxed);
+        i = end;
+        continue;
+      }
+    }
+
+    if (event->type == EV_KEY && event->code < KEY_CNT && event->value != 2)
+    {
+      unsigned long bit = 1UL << (event->code % (8 * sizeof(long)));
+      if (event->value)
+        d->keys[event->code / (8 * sizeof(long))] |= bit;
+      else
+        d->keys[event->code / (8 * sizeof(long))] &= ~bit;
+    }
+
+    frame_start = event->type == EV_SYN && event->code == SYN_REPORT;
+    process_event(d, event, overloaded ? &merge : NULL);
+  }
+
+  if (overloaded) rel_merge_flush(&merge);
+}
+
+/* --- Overload Protection --- */
+
+/*
+ * Under a storm the loop keeps up by doing less per event, never by
+ * guessing at state: repeat frames are shed, mouse motion within a batch
+ * is merged into one frame, and key presses/releases (including the
+ * toggle key) are always processed in order. If the kernel still drops
+ * events (SYN_DROPPED), key state is re-read with EVIOCGKEY and the
+ * differences are replayed so nothing stays stuck.
+ */
+
+static int overload_check(device_t *d, const struct input_event *evs, size_t n)
+{
+  long long now = mono_us();
+
+  if (now - d->window_start_us >= OVERLOAD_WINDOW_US)
+  {
+    d->window_start_us = now;
+    d->window_events = 0;
+  }
+  d->window_events += (unsigned)n;
+
+  /* Ignore age if the device clock is not CLOCK_MONOTONIC */
+  long long t = (long long)evs[0].input_event_sec * 1000000LL + evs[0].input_event_usec;
+  long long age = now - t;
+  int late = age > OVERLOAD_AGE_US && age < 10 * 1000000LL;
+
+  int overloaded = late || d->window_events > OVERLOAD_WINDOW_EVENTS;
+  if (overloaded != d->overloaded)
+  {
+    log_message("%s: overload %s", d->name, overloaded ? "on" : "off");
+    d->overloaded = overloaded;
+  }
+
+  if (overloaded)
+    atomic_fetch_add_explicit(&app_state.overload.batches, 1, memory_order_relaxed);
+  return overloaded;
+}
+
+/* If the frame starting at i only repeats keys, returns the index of its
+ * SYN_REPORT; otherwise (or if the frame is incomplete) returns i */
+static size_t frame_repeat_end(const struct input_event *evs, size_t n, size_t i)
+{
+  int repeats = 0;
+
+  for (size_t j = i; j < n; j++)
+  {
+    if (evs[j].type == EV_SYN && evs[j].code == SYN_REPORT)
+      return repeats ? j : i;
+
+    if (evs[j].type == EV_KEY)
+    {
+      if (evs[j].value != 2) return i;
+      repeats = 1;
+    }
+  }
+
+  return i;
+}
+
+static void rel_merge_add(rel_merge_t *m, const struct input_event *ev)
+{
+  switch (ev->code)
+  {
+  case REL_X: m->dx += ev->value; break;
+  case REL_Y: m->dy += ev->value; break;
+  case REL_WHEEL: m->wheel += ev->value; break;
+  case REL_HWHEEL: m->hwheel += ev->value; break;
+  default:
+    rel_merge_flush(m);
+    emit_event(&app_state.mouse.out, ev);
+    return;
+  }
+
+  if (m->count++)
+    atomic_fetch_add_explicit(&app_state.overload.merged, 1, memory_order_relaxed);
+  else
+    m->first = *ev;
+}
+
+static void rel_merge_flush(rel_merge_t *m)
+{
+  struct input_event frame[5];
+  const int vals[4] = {m->dx, m->dy, m->wheel, m->hwheel};
+  const unsigned short codes[4] = {REL_X, REL_Y, REL_WHEEL, REL_HWHEEL};
+  size_t n = 0;
+
+  if (!m->count) return;
+
+  for (int i = 0; i < 4; i++)
+  {
+    if (!vals[i]) continue;
+    frame[n] = m->first;
+    frame[n].type = EV_REL;
+    frame[n].code = codes[i];
+    frame[n].value = vals[i];
+    n++;
+  }
+
+  /* Opposite moves can cancel out completely */
+  if (n)
+  {
+    memset(&frame[n], 0, sizeof(frame[n]));
+    frame[n].type = EV_SYN;
+    frame[n].code = SYN_REPORT;
+    emit_write(&app_state.mouse.out, frame, n + 1);
+  }
+
+  memset(m, 0, sizeof(*m));
+}
+
+/* Replays presses/releases lost in a kernel buffer overflow */
+static void device_resync_keys(device_t *d)
+{
+  unsigned long now[KEY_LONGS];
+  const size_t bits = 8 * sizeof(long);
+
+  memset(now, 0, sizeof(now));
+  if (ioctl(d->fd, EVIOCGKEY(sizeof(now)), now) < 0)
+  {
+    log_perror("EVIOCGKEY");
+    return;
+  }
+
+  atomic_fetch_add_explicit(&app_state.overload.resyncs, 1, memory_order_relaxed);
+  log_message("%s: events dropped by the kernel, resyncing keys", d->name);
+
+  long long t = mono_us();
+
+  for (size_t w = 0; w < KEY_LONGS; w++)
+  {
+    if (d->keys[w] == now[w]) continue;
+
+    for (size_t b = 0; b < bits; b++)
+    {
+      unsigned long bit = 1UL << b;
+      if ((d->keys[w] & bit) == (now[w] & bit)) continue;
+
+      unsigned short code = (unsigned short)(w * bits + b);
+      int down = (now[w] & bit) != 0;
+      d->keys[w] ^= bit;
+
+      /* A replayed toggle tap would flip the mode; just forget the press */
+      if (code == KEY_HELP || code == KEY_F12 || code == KEY_FOCUS)
+      {
+        if (!down) app_state.mouse.toggle_down_at_ms = 0;
+        continue;
+      }
+
+      struct input_event ev;
+      memset(&ev, 0, sizeof(ev));
+      ev.input_event_sec = t / 1000000LL;
+      ev.input_event_usec = t % 1000000LL;
+      ev.type = EV_KEY;
+      ev.code = code;
+      ev.value = down;
+      process_event(d, &ev, NULL);
+    }
+  }
+}
+
+static void overload_reset(void)
+{
+  overload_t *o = &app_state.overload;
+  atomic_store_explicit(&o->batches, 0, memory_order_relaxed);
+  atomic_store_explicit(&o->shed, 0, memory_order_relaxed);
+  atomic_store_explicit(&o->merged, 0, memory_order_relaxed);
+  atomic_store_explicit(&o->syn_dropped, 0, memory_order_relaxed);
+  atomic_store_explicit(&o->resyncs, 0, memory_order_relaxed);
+}
+
+static int run_select_loop(void)
+{
+  struct input_event events[READ_BATCH];
+  fd_set fds, rfds;
+  int maxfd = 0;
+
+  FD_ZERO(&fds);
+  for (device_t *d = app_state.devices; d; d = d->next)
+  {
+    FD_SET(d->fd, &fds);
+    if (d->fd >= maxfd) maxfd = d->fd + 1;
+  }
 
-  case KEY_B:
-    if (ev->value == 1)
+  if (app_state.control_fd >= 0)
+  {
+    FD_SET(app_state.control_fd, &fds);
+    if (app_state.control_fd >= maxfd) maxfd = app_state.control_fd + 1;
+  }
+
+  log_message("Entering main event loop");
+  app_state.running = 1;
+
+  while (app_state.running)
+  {
+    rfds = fds;
+
+    struct timeval tv;
+    tv.tv_sec = 0;
+    tv.tv_usec = 200000;
+
+    int sel = select(control_fdset(&rfds, maxfd), &rfds, NULL, NULL, &tv);
+    if (sel < 0)
     {
-      app_state.mouse.drag_mode = !app_state.mouse.drag_mode;
-      log_message("Drag mode %s", app_state.mouse.drag_mode ? "enabled" : "disabled");
-      ev->type = EV_KEY;
-      ev->code = BTN_LEFT;
-      ev->value = app_state.mouse.drag_mode ? 1 : 0;
-      return CHANGED_TO_MOUSE;
+      if (errno == EINTR) continue;
+      log_message("ERROR: select() failed");
+      log_perror("select");
+      break;
     }
-    break;
 
-  case KEY_UP:
-    ev->type = EV_REL;
-    ev->code = REL_Y;
-    ev->value = -app_state.mouse.speed;
-    return CHANGED_TO_MOUSE;
+    if (sel > 0 && app_state.control_fd >= 0 && FD_ISSET(app_state.control_fd, &rfds))
+      control_handle_ready();
+    else if (app_state.nclients)
+      control_serve_clients(); /* readable, or timing out */
 
-  case KEY_DOWN:
-    ev->type = EV_REL;
-    ev->code = REL_Y;
-    ev->value = app_state.mouse.speed;
-    return CHANGED_TO_MOUSE;
+    if (sel == 0) continue;
 
-  case KEY_LEFT:
-    ev->type = EV_REL;
-    ev->code = REL_X;
-    ev->value = -app_state.mouse.speed;
-    return CHANGED_TO_MOUSE;
+    for (device_t *d = app_state.devices; d; d = d->next)
+    {
+      if (!FD_ISSET(d->fd, &rfds)) continue;
 
-  case KEY_RIGHT:
-    ev->type = EV_REL;
-    ev->code = REL_X;
-    ev->value = app_state.mouse.speed;
-    return CHANGED_TO_MOUSE;
+      ssize_t r = read(d->fd, events, sizeof(events));
+      if (r < (ssize_t)sizeof(events[0]))
+      {
+        log_message("ERROR: Failed to read event");
+        continue;
+      }
 
-  case KEY_MENU:
-    if (slowdown_counter++ % WHEEL_SLOWDOWN_FACTOR)
-      return MUTE_EVENT;
+      process_events(d, events, (size_t)r / sizeof(events[0]));
+    }
+  }
 
-    ev->type = EV_REL;
-    ev->code = REL_WHEEL;
-    ev->value = 1;
-    return CHANGED_TO_MOUSE;
+  return 0;
+}
 
-  case KEY_SEND:
-    if (slowdown_counter++ % WHEEL_SLOWDOWN_FACTOR)
-      return MUTE_EVENT;
+static int run_event_loop(void)
+{
+  log_message("Using %s event loop", app_state.loop->name);
+  return app_state.loop->run();
+}
 
-    ev->type = EV_REL;
-    ev->code = REL_WHEEL;
-    ev->value = -1;
-    return CHANGED_TO_MOUSE;
+/* --- io_uring Event Loop --- */
 
-  default:
-    return PASS_THRU_EVENT;
+#ifdef HAVE_IO_URING
+
+/*
+ * Every grabbed evdev fd keeps a multishot read posted against a ring of
+ * provided buffers, and the control socket keeps a multishot poll. Frames
+ * produced while handling completions are queued as linked uinput writes
+ * and go out with the next io_uring_enter, which also waits for input.
+ *
+ * Kernels without multishot read (< 6.7) or provided buffer rings (< 5.19)
+ * fall back to single-shot reads re-armed after each completion; kernels
+ * without io_uring at all fall back to the select loop.
+ */
+
+#define URING_ENTRIES 64
+#define URING_BGID 0
+#define URING_BUFS 16     /* provided read buffers, power of two */
+#define URING_WBUFS 32    /* uinput frames in flight */
+#define URING_FRAME_MAX 6 /* events per queued frame (merged motion is up to 5) */
+#define URING_OP_READ_MULTISHOT 49 /* IORING_OP_READ_MULTISHOT, not in older headers */
+
+/* user_data: tag in the top byte, index below */
+#define URING_TAG_READ  1ULL
+#define URING_TAG_CTRL  2ULL
+#define URING_TAG_WRITE 3ULL
+#define URING_TAG_CLIENT 4ULL
+#define URING_UD(tag, idx) (((tag) << 56) | (unsigned long long)(idx))
+
+typedef struct input_event uring_rbuf_t[READ_BATCH];
+
+typedef struct
+{
+  struct input_event evs[URING_FRAME_MAX];
+  size_t n;
+  int busy;
+} uring_wbuf_t;
+
+typedef struct
+{
+  int fd;
+  int active;
+  int ext_arg;
+  int multishot;
+  int ctrl_multishot;
+
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  void *sq_ring, *cq_ring;
+  size_t sq_ring_sz, cq_ring_sz, sqes_sz;
+  unsigned sq_entries;
+  unsigned local_tail;
+  struct io_uring_sqe *last_write;
+
+  /* device index -> device, and per-device buffers for single-shot reads */
+  device_t **devs;
+  uring_rbuf_t *rbufs;
+  size_t ndevs;
+
+  /* single-shot reads to re-arm once the completion batch is handled */
+  size_t *rearm;
+  size_t nrearm;
+
+  /* provided buffer ring for multishot reads */
+  struct io_uring_buf_ring *br;
+  uring_rbuf_t *pbufs;
+
+  uring_wbuf_t wbufs[URING_WBUFS];
+  unsigned wnext;
+} uring_t;
+
+static uring_t uring;
+
+static int uring_enter(unsigned to_submit, unsigned min_complete, unsigned flags,
+                       const void *arg, size_t argsz)
+{
+  return (int)syscall(__NR_io_uring_enter, uring.fd, to_submit, min_complete,
+                      flags, arg, argsz);
+}
+
+static struct io_uring_sqe *uring_get_sqe(void)
+{
+  if (uring.local_tail - __atomic_load_n(uring.sq_head, __ATOMIC_ACQUIRE) >= uring.sq_entries)
+    uring_submit();
+
+  struct io_uring_sqe *sqe = &uring.sqes[uring.local_tail & *uring.sq_mask];
+  uring.local_tail++;
+  memset(sqe, 0, sizeof(*sqe));
+  return sqe;
+}
+
+/* Publish queued SQEs without waiting for completions */
+static void uring_submit(void)
+{
+  if (!uring.active) return;
+
+  unsigned pending = uring.local_tail - *uring.sq_tail;
+  uring.last_write = NULL;
+  if (!pending) return;
+
+  __atomic_store_n(uring.sq_tail, uring.local_tail, __ATOMIC_RELEASE);
+  while (uring_enter(pending, 0, 0, NULL, 0) < 0)
+  {
+    if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+    {
+      log_perror("io_uring_enter(submit)");
+      break;
+    }
   }
+}
 
-  return PASS_THRU_EVENT;
+/* Submit anything queued and wait for at least one completion */
+static int uring_submit_and_wait(void)
+{
+  unsigned pending = uring.local_tail - *uring.sq_tail;
+  uring.last_write = NULL;
+  __atomic_store_n(uring.sq_tail, uring.local_tail, __ATOMIC_RELEASE);
+
+  if (uring.ext_arg)
+  {
+    /* Same 200ms wakeup as the select loop */
+    struct __kernel_timespec ts = {0, 200000000};
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = (unsigned long long)(uintptr_t)&ts;
+    return uring_enter(pending, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                       &arg, sizeof(arg));
+  }
+  return uring_enter(pending, 1, IORING_ENTER_GETEVENTS, NULL, 0);
 }
 
-/* --- Device Management Functions --- */
+static void uring_recycle_buf(unsigned short bid)
+{
+  unsigned short tail = uring.br->tail;
+  struct io_uring_buf *buf = &uring.br->bufs[tail & (URING_BUFS - 1)];
 
-static int devices_find_and_init(void)
+  buf->addr = (unsigned long long)(uintptr_t)uring.pbufs[bid];
+  buf->len = sizeof(uring.pbufs[bid]);
+  buf->bid = bid;
+  __atomic_store_n(&uring.br->tail, (unsigned short)(tail + 1), __ATOMIC_RELEASE);
+}
+
+static void uring_arm_read(size_t idx)
 {
-  DIR *dir;
-  struct dirent *file;
-  int result = -1;
+  struct io_uring_sqe *sqe = uring_get_sqe();
 
-  dir = opendir(DEV_INPUT);
-  if (!dir)
+  sqe->fd = uring.devs[idx]->fd;
+  sqe->off = (unsigned long long)-1;
+  sqe->user_data = URING_UD(URING_TAG_READ, idx);
+
+  if (uring.multishot)
   {
-    log_message("ERROR: Failed to open directory %s", DEV_INPUT);
-    log_perror("opendir");
+    sqe->opcode = URING_OP_READ_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BGID;
+  }
+  else
+  {
+    sqe->opcode = IORING_OP_READ;
+    sqe->addr = (unsigned long long)(uintptr_t)uring.rbufs[idx];
+    sqe->len = sizeof(uring.rbufs[idx]);
+  }
+}
+
+static void uring_arm_ctrl(void)
+{
+  struct io_uring_sqe *sqe = uring_get_sqe();
+
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = app_state.control_fd;
+  sqe->poll32_events = POLLIN;
+  sqe->len = uring.ctrl_multishot ? IORING_POLL_ADD_MULTI : 0;
+  sqe->user_data = URING_UD(URING_TAG_CTRL, 0);
+}
+
+/* One-shot poll on a control client, cancelled by a linked timeout */
+static void uring_watch_client(int fd)
+{
+  static const struct __kernel_timespec timeout = {0, CONTROL_CLIENT_TIMEOUT_MS * 1000000LL};
+
+  if (!uring.active) return;
+
+  /* Both SQEs must go in one submission or the link is lost */
+  if (uring.local_tail - __atomic_load_n(uring.sq_head, __ATOMIC_ACQUIRE) + 2 > uring.sq_entries)
+    uring_submit();
+
+  struct io_uring_sqe *sqe = uring_get_sqe();
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = fd;
+  sqe->poll32_events = POLLIN;
+  sqe->flags = IOSQE_IO_LINK;
+  sqe->user_data = URING_UD(URING_TAG_CLIENT, 0);
+
+  sqe = uring_get_sqe();
+  sqe->opcode = IORING_OP_LINK_TIMEOUT;
+  sqe->fd = -1;
+  sqe->addr = (unsigned long long)(uintptr_t)&timeout;
+  sqe->len = 1;
+  sqe->user_data = URING_UD(URING_TAG_CLIENT, 1);
+}
+
+static void uring_queue_write(const uout_t *out, const struct input_event *evs, size_t n)
+{
+  int fd = uout_fd(out);
+  uring_wbuf_t *wb = &uring.wbufs[uring.wnext];
+
+  if (!uring.active || fd < 0 || n > URING_FRAME_MAX || wb->busy)
+  {
+    /* Not running, or out of frame slots: flush what is queued, write inline */
+    uring_submit();
+    uout_write(out, evs, n);
+    return;
+  }
+
+  memcpy(wb->evs, evs, n * sizeof(*evs));
+  wb->n = n;
+  wb->busy = 1;
+
+  struct io_uring_sqe *sqe = uring_get_sqe();
+  sqe->opcode = IORING_OP_WRITE;
+  sqe->fd = fd;
+  sqe->off = (unsigned long long)-1;
+  sqe->addr = (unsigned long long)(uintptr_t)wb->evs;
+  sqe->len = (unsigned)(n * sizeof(*evs));
+  sqe->user_data = URING_UD(URING_TAG_WRITE, uring.wnext);
+
+  /*
+   * Keep frames ordered: each write waits for the previous one. A link
+   * joins the next SQE in the ring, so only chain onto a write that is
+   * directly before this one; after anything else start a new chain.
+   */
+  if (uring.last_write && uring.last_write == &uring.sqes[(uring.local_tail - 2) & *uring.sq_mask])
+    uring.last_write->flags |= IOSQE_IO_LINK;
+  uring.last_write = sqe;
+
+  uring.wnext = (uring.wnext + 1) % URING_WBUFS;
+}
+
+static void uring_cleanup(void)
+{
+  uring.active = 0;
+
+  if (uring.br) munmap(uring.br, URING_BUFS * sizeof(struct io_uring_buf));
+  if (uring.sqes) munmap(uring.sqes, uring.sqes_sz);
+  if (uring.cq_ring && uring.cq_ring != uring.sq_ring) munmap(uring.cq_ring, uring.cq_ring_sz);
+  if (uring.sq_ring) munmap(uring.sq_ring, uring.sq_ring_sz);
+  if (uring.fd >= 0) close(uring.fd);
+
+  free(uring.pbufs);
+  free(uring.rearm);
+  free(uring.rbufs);
+  free(uring.devs);
+  memset(&uring, 0, sizeof(uring));
+  uring.fd = -1;
+}
+
+static int uring_init(void)
+{
+  struct io_uring_params p;
+
+  memset(&uring, 0, sizeof(uring));
+  memset(&p, 0, sizeof(p));
+
+  uring.fd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+  if (uring.fd < 0)
+  {
+    log_perror("io_uring_setup");
+    uring.fd = -1;
     return -1;
   }
 
-  while ((file = readdir(dir)) != NULL)
+  uring.sq_entries = p.sq_entries;
+  uring.ext_arg = (p.features & IORING_FEAT_EXT_ARG) != 0;
+  uring.sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  uring.cq_ring_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  uring.sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+
+  if (p.features & IORING_FEAT_SINGLE_MMAP)
   {
-    char file_path[256];
-    int found = 0;
+    if (uring.cq_ring_sz > uring.sq_ring_sz) uring.sq_ring_sz = uring.cq_ring_sz;
+    uring.cq_ring_sz = uring.sq_ring_sz;
+  }
 
-    if (file->d_type != DT_CHR)
-      continue;
+  uring.sq_ring = mmap(NULL, uring.sq_ring_sz, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, uring.fd, IORING_OFF_SQ_RING);
+  if (uring.sq_ring == MAP_FAILED)
+  {
+    uring.sq_ring = NULL;
+    goto fail;
+  }
 
-    snprintf(file_path, sizeof(file_path), "%s/%s", DEV_INPUT, file->d_name);
-    log_message("Checking device %s", file_path);
+  if (p.features & IORING_FEAT_SINGLE_MMAP)
+  {
+    uring.cq_ring = uring.sq_ring;
+  }
+  else
+  {
+    uring.cq_ring = mmap(NULL, uring.cq_ring_sz, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, uring.fd, IORING_OFF_CQ_RING);
+    if (uring.cq_ring == MAP_FAILED)
+    {
+      uring.cq_ring = NULL;
+      goto fail;
+    }
+  }
+
+  uring.sqes = mmap(NULL, uring.sqes_sz, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, uring.fd, IORING_OFF_SQES);
+  if (uring.sqes == MAP_FAILED)
+  {
+    uring.sqes = NULL;
+    goto fail;
+  }
+
+  uring.sq_head = (unsigned *)((char *)uring.sq_ring + p.sq_off.head);
+  uring.sq_tail = (unsigned *)((char *)uring.sq_ring + p.sq_off.tail);
+  uring.sq_mask = (unsigned *)((char *)uring.sq_ring + p.sq_off.ring_mask);
+  uring.sq_array = (unsigned *)((char *)uring.sq_ring + p.sq_off.array);
+  uring.cq_head = (unsigned *)((char *)uring.cq_ring + p.cq_off.head);
+  uring.cq_tail = (unsigned *)((char *)uring.cq_ring + p.cq_off.tail);
+  uring.cq_mask = (unsigned *)((char *)uring.cq_ring + p.cq_off.ring_mask);
+  uring.cqes = (struct io_uring_cqe *)((char *)uring.cq_ring + p.cq_off.cqes);
+
+  /* SQ slots map 1:1 onto SQEs */
+  for (unsigned i = 0; i < p.sq_entries; i++) uring.sq_array[i] = i;
+  uring.local_tail = *uring.sq_tail;
+
+  for (device_t *d = app_state.devices; d; d = d->next) uring.ndevs++;
+  uring.devs = (device_t **)calloc(uring.ndevs, sizeof(*uring.devs));
+  uring.rbufs = (uring_rbuf_t *)calloc(uring.ndevs, sizeof(*uring.rbufs));
+  uring.rearm = (size_t *)calloc(uring.ndevs, sizeof(*uring.rearm));
+  if (!uring.devs || !uring.rbufs || !uring.rearm) goto fail;
+
+  size_t idx = 0;
+  for (device_t *d = app_state.devices; d; d = d->next) uring.devs[idx++] = d;
+
+  /* Provided buffer ring for multishot reads */
+  uring.br = (struct io_uring_buf_ring *)mmap(NULL, URING_BUFS * sizeof(struct io_uring_buf),
+                                              PROT_READ | PROT_WRITE,
+                                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  uring.pbufs = (uring_rbuf_t *)calloc(URING_BUFS, sizeof(*uring.pbufs));
+  if (uring.br == MAP_FAILED) uring.br = NULL;
+
+  if (uring.br && uring.pbufs)
+  {
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (unsigned long long)(uintptr_t)uring.br;
+    reg.ring_entries = URING_BUFS;
+    reg.bgid = URING_BGID;
 
-    int fd = open(file_path, O_RDONLY);
-    if (fd < 0)
+    if (syscall(__NR_io_uring_register, uring.fd, IORING_REGISTER_PBUF_RING, &reg, 1) == 0)
     {
-      log_message("ERROR: Failed to open device file %s", file_path);
-      log_perror("open");
-      continue;
+      uring.multishot = 1;
+      for (unsigned short bid = 0; bid < URING_BUFS; bid++) uring_recycle_buf(bid);
     }
+  }
 
-    struct libevdev *evdev = NULL;
-    if (libevdev_new_from_fd(fd, &evdev) < 0)
+  if (!uring.multishot)
+    log_message("io_uring: no provided buffer rings, using single-shot reads");
+
+  uring.ctrl_multishot = 1;
+  uring.active = 1;
+  return 0;
+
+fail:
+  log_perror("io_uring init");
+  uring_cleanup();
+  return -1;
+}
+
+static void uring_handle_read(size_t idx, const struct io_uring_cqe *cqe)
+{
+  int more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+
+  if (cqe->res > 0)
+  {
+    size_t n = (size_t)cqe->res / sizeof(struct input_event);
+
+    if (cqe->flags & IORING_CQE_F_BUFFER)
     {
-      log_message("ERROR: Failed to create libevdev from fd %d", fd);
-      close(fd);
-      continue;
+      unsigned short bid = (unsigned short)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+      process_events(uring.devs[idx], uring.pbufs[bid], n);
+      uring_recycle_buf(bid);
+    }
+    else
+    {
+      process_events(uring.devs[idx], uring.rbufs[idx], n);
     }
+  }
+  else if (cqe->res == -EINVAL && uring.multishot)
+  {
+    log_message("io_uring: multishot read unsupported, using single-shot reads");
+    uring.multishot = 0;
+  }
+  else if (cqe->res != -ENOBUFS && cqe->res != -EINTR && cqe->res != -EAGAIN &&
+           cqe->res != -ECANCELED)
+  {
+    /* Device gone or broken: stop reading it rather than spin */
+    log_message("ERROR: io_uring read on %s failed (res=%d)", uring.devs[idx]->name, cqe->res);
+    return;
+  }
 
-    for (int i = 0; supported_devices[i]; i++)
+  /* Re-armed after the batch so this batch's writes stay one chain */
+  if (!more && app_state.running) uring.rearm[uring.nrearm++] = idx;
+}
+
+static void uring_handle_cqe(const struct io_uring_cqe *cqe)
+{
+  unsigned long long tag = cqe->user_data >> 56;
+  size_t idx = (size_t)(cqe->user_data & 0xffffffffULL);
+
+  switch (tag)
+  {
+  case URING_TAG_READ:
+    uring_handle_read(idx, cqe);
+    break;
+
+  case URING_TAG_CTRL:
+    if (cqe->res > 0)
     {
-      if (strcmp(libevdev_get_name(evdev), supported_devices[i]) == 0)
-      {
-        log_message("Found supported device: %s", libevdev_get_name(evdev));
+      control_handle_ready();
+    }
+    else if (cqe->res == -EINVAL && uring.ctrl_multishot)
+    {
+      uring.ctrl_multishot = 0;
+    }
+    else
+    {
+      log_message("ERROR: io_uring control poll failed (res=%d)", cqe->res);
+      break;
+    }
 
-        device_t *dev = (device_t *)malloc(sizeof(device_t));
-        if (!dev)
-        {
-          log_message("ERROR: Failed to allocate memory for device");
-          libevdev_free(evdev);
-          close(fd);
-          continue;
-        }
+    if (!(cqe->flags & IORING_CQE_F_MORE) && app_state.running) uring_arm_ctrl();
+    break;
 
-        dev->fd = fd;
-        dev->name = libevdev_get_name(evdev);
-        dev->evdev = evdev;
-        dev->uidev = NULL;
-        dev->next = NULL;
+  case URING_TAG_CLIENT:
+    /* Readable, or the linked timeout fired: either way serve or expire */
+    if (app_state.nclients) control_serve_clients();
+    break;
 
-        if (ioctl(dev->fd, EVIOCGRAB, 1) < 0)
-          log_message("WARNING: Failed to grab device exclusively");
+  case URING_TAG_WRITE:
+    uring.wbufs[idx].busy = 0;
+    if (cqe->res > 0) latency_record_frame(uring.wbufs[idx].evs, uring.wbufs[idx].n);
+    if (cqe->res < 0 && cqe->res != -ECANCELED)
+      log_message("ERROR: io_uring uinput write failed (res=%d)", cqe->res);
+    break;
+  }
+}
 
-        if (libevdev_uinput_create_from_device(dev->evdev,
-                                               LIBEVDEV_UINPUT_OPEN_MANAGED,
-                                               &(dev->uidev)) < 0)
-        {
-          log_message("ERROR: Failed to create uinput device");
-          libevdev_free(evdev);
-          close(fd);
-          free(dev);
-          continue;
-        }
+static int run_uring_loop(void)
+{
+  if (uring_init() < 0)
+  {
+    log_message("WARNING: io_uring unavailable, falling back to select loop");
+    app_state.loop = &loop_backends[0];
+    return run_select_loop();
+  }
 
-        log_message("Successfully attached device: %s", dev->name);
+  app_state.running = 1;
 
-        if (i > 1)
-        {
-          log_message("Using laptop keymap");
-          app_state.keymap = laptop_keymap;
-          app_state.keymap_size = sizeof(laptop_keymap) / sizeof(laptop_keymap[0]);
-        }
-        else
-        {
-          app_state.keymap = keypad_keymap;
-          app_state.keymap_size = sizeof(keypad_keymap) / sizeof(keypad_keymap[0]);
-        }
+  for (size_t i = 0; i < uring.ndevs; i++) uring_arm_read(i);
+  if (app_state.control_fd >= 0) uring_arm_ctrl();
 
-        if (!app_state.devices)
-        {
-          app_state.devices = dev;
-        }
-        else
-        {
-          device_t *d = app_state.devices;
-          while (d->next) d = d->next;
-          d->next = dev;
-        }
+  log_message("Entering io_uring event loop (%s reads)",
+              uring.multishot ? "multishot" : "single-shot");
 
-        found = 1;
-        result = 0;
-        break;
-      }
+  while (app_state.running)
+  {
+    if (uring_submit_and_wait() < 0 && errno != EINTR && errno != ETIME && errno != EAGAIN)
+    {
+      log_message("ERROR: io_uring_enter() failed");
+      log_perror("io_uring_enter");
+      break;
     }
 
-    if (!found)
+    unsigned head = *uring.cq_head;
+    while (head != __atomic_load_n(uring.cq_tail, __ATOMIC_ACQUIRE))
     {
-      log_message("Device %s not in supported list", file_path);
-      libevdev_free(evdev);
-      close(fd);
+      struct io_uring_cqe cqe = uring.cqes[head & *uring.cq_mask];
+      head++;
+      /* Release the slot first; handlers may submit more work */
+      __atomic_store_n(uring.cq_head, head, __ATOMIC_RELEASE);
+      uring_handle_cqe(&cqe);
     }
+
+    for (size_t i = 0; i < uring.nrearm; i++) uring_arm_read(uring.rearm[i]);
+    uring.nrearm = 0;
+
+    /* Expire stalled clients even if their linked timeout is unsupported */
+    if (app_state.nclients) control_serve_clients();
   }
 
-  closedir(dir);
-  return result;
+  /* Push out any final frames before the devices go away */
+  uring_submit();
+  uring_cleanup();
+  app_state.loop = &loop_backends[0];
+  return 0;
 }
 
-static void devices_cleanup(void)
+#endif /* HAVE_IO_URING */
+
+/* --- Pipelined Event Loop --- */
+
+/*
+ * One reader thread per grabbed device feeds an MPSC queue drained by the
+ * translator (the main thread). Translated frames go through a second MPSC
+ * queue to a writer thread that owns all uinput writes and coalesces
+ * back-to-back frames for the same device into one write(). The control
+ * socket is served from its own thread. It only flips atomics itself;
+ * anything that moves the pointer or touches translator-owned state is
+ * queued to the translator as a message (translator_post).
+ *
+ * The queues are bounded Vyukov rings. Semaphores put an idle consumer,
+ * or a producer facing a full ring, to sleep; nothing spins.
+ */
+
+#define PIPE_SLOTS 128 /* power of two */
+
+typedef struct
 {
-  device_t *curr = app_state.devices;
+  device_t *dev;      /* input side; NULL for a translator_post() message */
+  const uout_t *out;  /* output side */
+  translator_op_t op;
+  int was, now;
+  size_t n;
+  struct input_event evs[READ_BATCH];
+} pipe_msg_t;
 
-  while (curr)
-  {
-    device_t *next = curr->next;
+typedef struct
+{
+  atomic_size_t seq;
+  pipe_msg_t msg;
+} pipe_cell_t;
 
-    if (curr->uidev) libevdev_uinput_destroy(curr->uidev);
-    if (curr->evdev) libevdev_free(curr->evdev);
-    if (curr->fd >= 0) close(curr->fd);
+typedef struct
+{
+  pipe_cell_t cells[PIPE_SLOTS];
+  atomic_size_t head;
+  size_t tail; /* single consumer */
+  sem_t items;
+  sem_t slots;
+} pipe_queue_t;
 
-    free(curr);
-    curr = next;
-  }
+typedef struct
+{
+  atomic_int active;
+  pipe_queue_t in;
+  pipe_queue_t out;
+} pipeline_t;
 
-  app_state.devices = NULL;
-  log_message("All input devices released");
-}
+static pipeline_t *pipeline;
 
-/* --- Event Handling Functions --- */
+static void pipe_queue_init(pipe_queue_t *q)
+{
+  for (size_t i = 0; i < PIPE_SLOTS; i++)
+    atomic_init(&q->cells[i].seq, i);
+  atomic_init(&q->head, 0);
+  q->tail = 0;
+  sem_init(&q->items, 0, 0);
+  sem_init(&q->slots, 0, PIPE_SLOTS);
+}
 
-static int handle_input_event(device_t *dev, struct input_event *ev)
+static int pipe_queue_try_push(pipe_queue_t *q, const pipe_msg_t *msg)
 {
-  (void)dev;
+  size_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
 
-  if (ev->type == EV_KEY)
+  for (;;)
   {
-    if (ev->code == KEY_HELP || ev->code == KEY_F12 || ev->code == KEY_FOCUS)
+    pipe_cell_t *cell = &q->cells[pos & (PIPE_SLOTS - 1)];
+    size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+    intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+    if (diff == 0)
     {
-      log_message("EV_KEY toggle candidate code=%d value=%d enabled=%d t=%ld.%06ld",
-                  ev->code, ev->value, app_state.mouse.enabled,
-                  (long)ev->input_event_sec, (long)ev->input_event_usec);
-      return mouse_toggle(ev);
+      if (atomic_compare_exchange_weak_explicit(&q->head, &pos, pos + 1,
+                                                memory_order_relaxed, memory_order_relaxed))
+      {
+        cell->msg = *msg;
+        atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+        sem_post(&q->items);
+        return 0;
+      }
+    }
+    else if (diff < 0)
+    {
+      return -1; /* full */
+    }
+    else
+    {
+      pos = atomic_load_explicit(&q->head, memory_order_relaxed);
     }
   }
+}
 
-  if (!app_state.mouse.enabled)
-    return PASS_THRU_EVENT;
-
-  return mouse_handle_event(dev, ev);
+/* Wait up to 200ms (like the select loop) on a semaphore */
+static int pipe_sem_wait(sem_t *sem)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_nsec += 200000000L;
+  if (ts.tv_nsec >= 1000000000L)
+  {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000L;
+  }
+  return sem_timedwait(sem, &ts);
 }
 
-/* --- Signal Handling --- */
+/*
+ * Push with backpressure: sleep until the consumer frees a slot rather
+ * than drop. Gives up only once the daemon is stopping, so a full queue
+ * cannot keep a reader from exiting.
+ */
+static int pipe_queue_push(pipe_queue_t *q, const pipe_msg_t *msg)
+{
+  while (pipe_sem_wait(&q->slots) < 0)
+  {
+    if (!app_state.running) return -1;
+  }
 
-static void signal_handler(int sig)
+  /* Holding a slot token; the consumer has released its cell or is about to */
+  while (pipe_queue_try_push(q, msg) < 0)
+    sched_yield();
+  return 0;
+}
+
+static int pipe_queue_try_pop(pipe_queue_t *q, pipe_msg_t *msg)
 {
-  log_message("Received signal %d, shutting down", sig);
-  app_state.running = 0;
+  pipe_cell_t *cell = &q->cells[q->tail & (PIPE_SLOTS - 1)];
+  size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+
+  if (seq != q->tail + 1) return -1; /* empty */
+
+  *msg = cell->msg;
+  atomic_store_explicit(&cell->seq, q->tail + PIPE_SLOTS, memory_order_release);
+  q->tail++;
+  sem_post(&q->slots);
+  return 0;
 }
 
-static void setup_signal_handlers(void)
+/* Wait up to 200ms for a message */
+static int pipe_queue_pop(pipe_queue_t *q, pipe_msg_t *msg)
 {
-  signal(SIGINT, signal_handler);
-  signal(SIGTERM, signal_handler);
-  signal(SIGHUP, signal_handler);
+  if (pipe_sem_wait(&q->items) < 0) return -1;
+  while (pipe_queue_try_pop(q, msg) < 0)
+    sched_yield(); /* push claimed the slot but has not published it yet */
+  return 0;
 }
 
-/* --- Main Event Loop --- */
+/* Non-blocking pop for batching; consumes a semaphore count on success */
+static int pipe_queue_pop_now(pipe_queue_t *q, pipe_msg_t *msg)
+{
+  if (sem_trywait(&q->items) < 0) return -1;
+  while (pipe_queue_try_pop(q, msg) < 0)
+    sched_yield();
+  return 0;
+}
 
-static int run_event_loop(void)
+static void pipeline_queue_write(const uout_t *out, const struct input_event *evs, size_t n)
 {
-  struct input_event event;
-  int event_result;
-  fd_set fds, rfds;
-  int maxfd = 0;
-  char prefix[8];
+  if (!pipeline || !atomic_load(&pipeline->active) || n > READ_BATCH)
+  {
+    uout_write(out, evs, n);
+    return;
+  }
 
-  FD_ZERO(&fds);
-  for (device_t *d = app_state.devices; d; d = d->next)
+  pipe_msg_t msg;
+  msg.dev = NULL;
+  msg.out = out;
+  msg.n = n;
+  memcpy(msg.evs, evs, n * sizeof(*evs));
+  pipe_queue_push(&pipeline->out, &msg);
+}
+
+static void translator_run(translator_op_t op, int was, int now)
+{
+  switch (op)
   {
-    FD_SET(d->fd, &fds);
-    if (d->fd >= maxfd) maxfd = d->fd + 1;
+  case TRANSLATOR_MODE:
+    write_status_file();
+    on_enabled_transition(was, now, "socket");
+    break;
+  case TRANSLATOR_ADAPTIVE_SAVE:
+    adaptive_save();
+    break;
   }
+}
 
-  if (app_state.control_fd >= 0)
+/* Run op on the translating thread: queued behind pending input in pipeline mode */
+static void translator_post(translator_op_t op, int was, int now)
+{
+  if (!pipeline || !atomic_load(&pipeline->active))
   {
-    FD_SET(app_state.control_fd, &fds);
-    if (app_state.control_fd >= maxfd) maxfd = app_state.control_fd + 1;
+    translator_run(op, was, now); /* control shares the loop's thread */
+    return;
   }
 
-  log_message("Entering main event loop");
-  app_state.running = 1;
+  pipe_msg_t msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.op = op;
+  msg.was = was;
+  msg.now = now;
+  if (pipe_queue_push(&pipeline->in, &msg) < 0)
+    log_message("Dropped control request %d (shutting down)", op);
+}
+
+static void *pipeline_reader(void *arg)
+{
+  device_t *d = (device_t *)arg;
+  struct pollfd pfd = {d->fd, POLLIN, 0};
+  pipe_msg_t msg;
+
+  msg.dev = d;
+  msg.out = NULL;
 
   while (app_state.running)
   {
-    rfds = fds;
-
-    struct timeval tv;
-    tv.tv_sec = 0;
-    tv.tv_usec = 200000;
+    int rc = poll(&pfd, 1, 200);
+    if (rc <= 0) continue;
 
-    int sel = select(maxfd, &rfds, NULL, NULL, &tv);
-    if (sel < 0)
+    ssize_t r = read(d->fd, msg.evs, sizeof(msg.evs));
+    if (r < (ssize_t)sizeof(msg.evs[0]))
     {
-      if (errno == EINTR) continue;
-      log_message("ERROR: select() failed");
-      log_perror("select");
-      break;
+      log_message("ERROR: Failed to read event");
+      if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) break;
+      continue;
     }
 
-    if (sel > 0 && app_state.control_fd >= 0 && FD_ISSET(app_state.control_fd, &rfds))
-      control_handle_ready();
+    msg.n = (size_t)r / sizeof(msg.evs[0]);
+    if (pipe_queue_push(&pipeline->in, &msg) < 0) break;
+  }
+  return NULL;
+}
 
-    if (sel == 0) continue;
+static void *pipeline_writer(void *arg)
+{
+  struct input_event batch[READ_BATCH * 4];
+  pipe_msg_t msg;
+  (void)arg;
 
-    for (device_t *d = app_state.devices; d; d = d->next)
+  for (;;)
+  {
+    if (pipe_queue_pop(&pipeline->out, &msg) < 0)
     {
-      if (!FD_ISSET(d->fd, &rfds)) continue;
+      if (!atomic_load(&pipeline->active)) break;
+      continue;
+    }
+
+    /* Coalesce queued frames for the same device into one write() */
+    const uout_t *out = msg.out;
+    size_t n = msg.n;
+    memcpy(batch, msg.evs, n * sizeof(batch[0]));
 
-      if (read(d->fd, &event, sizeof(event)) != sizeof(event))
+    while (pipe_queue_pop_now(&pipeline->out, &msg) == 0)
+    {
+      if (msg.out != out || n + msg.n > sizeof(batch) / sizeof(batch[0]))
       {
-        log_message("ERROR: Failed to read event");
-        continue;
+        uout_write(out, batch, n);
+        out = msg.out;
+        n = 0;
       }
+      memcpy(&batch[n], msg.evs, msg.n * sizeof(batch[0]));
+      n += msg.n;
+    }
 
-#ifdef DEBUG
-      snprintf(prefix, sizeof(prefix), "<%d<", d->fd);
-      log_event(prefix, &event);
-#endif
+    uout_write(out, batch, n);
+  }
+  return NULL;
+}
 
-      event_result = handle_input_event(d, &event);
+static void *pipeline_control(void *arg)
+{
+  struct pollfd pfds[1 + CONTROL_CLIENTS_MAX];
+  (void)arg;
 
-      if (event_result > 0)
-      {
-#ifdef DEBUG
-        snprintf(prefix, sizeof(prefix), ">%d>", d->fd);
-        log_event(prefix, &event);
-#endif
-        libevdev_uinput_write_event(d->uidev, event.type, event.code, event.value);
-        libevdev_uinput_write_event(d->uidev, EV_SYN, SYN_REPORT, 0);
-      }
-      else if (event_result < 0)
-      {
-#ifdef DEBUG
-        log_event(">M>", &event);
-#endif
-        libevdev_uinput_write_event(app_state.mouse.uidev, event.type, event.code, event.value);
-        libevdev_uinput_write_event(app_state.mouse.uidev, EV_SYN, SYN_REPORT, 0);
-      }
+  pfds[0].fd = app_state.control_fd;
+  pfds[0].events = POLLIN;
+
+  while (app_state.running)
+  {
+    size_t n = 1;
+    for (size_t i = 0; i < app_state.nclients; i++, n++)
+    {
+      pfds[n].fd = app_state.clients[i].fd;
+      pfds[n].events = POLLIN;
     }
+
+    int rc = poll(pfds, n, app_state.nclients ? CONTROL_CLIENT_TIMEOUT_MS : 200);
+    if (rc > 0 && (pfds[0].revents & POLLIN)) control_handle_ready();
+    else if (app_state.nclients) control_serve_clients();
+  }
+  return NULL;
+}
+
+static int run_pipeline_loop(void)
+{
+  size_t ndevs = 0;
+  for (device_t *d = app_state.devices; d; d = d->next) ndevs++;
+
+  pthread_t *readers = (pthread_t *)calloc(ndevs, sizeof(*readers));
+  pipeline = (pipeline_t *)calloc(1, sizeof(*pipeline));
+  if (!readers || !pipeline)
+  {
+    log_message("ERROR: Failed to allocate pipeline, falling back to select loop");
+    free(readers);
+    free(pipeline);
+    pipeline = NULL;
+    app_state.loop = &loop_backends[0];
+    return run_select_loop();
   }
 
+  pipe_queue_init(&pipeline->in);
+  pipe_queue_init(&pipeline->out);
+  atomic_store(&pipeline->active, 1);
+  app_state.running = 1;
+
+  pthread_t writer, control;
+  int have_control = 0;
+  size_t nreaders = 0;
+
+  pthread_create(&writer, NULL, pipeline_writer, NULL);
+  if (app_state.control_fd >= 0)
+    have_control = pthread_create(&control, NULL, pipeline_control, NULL) == 0;
+  for (device_t *d = app_state.devices; d; d = d->next)
+  {
+    if (pthread_create(&readers[nreaders], NULL, pipeline_reader, d) == 0) nreaders++;
+    else log_message("ERROR: Failed to start reader for %s", d->name);
+  }
+
+  log_message("Entering pipelined event loop (%zu readers)", nreaders);
+
+  pipe_msg_t msg;
+  while (app_state.running)
+  {
+    if (pipe_queue_pop(&pipeline->in, &msg) < 0) continue;
+
+    if (msg.dev) process_events(msg.dev, msg.evs, msg.n);
+    else translator_run(msg.op, msg.was, msg.now);
+  }
+
+  for (size_t i = 0; i < nreaders; i++) pthread_join(readers[i], NULL);
+  if (have_control) pthread_join(control, NULL);
+
+  /* Writer drains what is left, then sees inactive + empty and exits */
+  atomic_store(&pipeline->active, 0);
+  pthread_join(writer, NULL);
+
+  sem_destroy(&pipeline->in.items);
+  sem_destroy(&pipeline->in.slots);
+  sem_destroy(&pipeline->out.items);
+  sem_destroy(&pipeline->out.slots);
+  free(pipeline);
+  free(readers);
+  pipeline = NULL;
+  app_state.loop = &loop_backends[0];
   return 0;
 }
 
@@ -992,44 +3691,181 @@ int main(int argc, char **argv)
     if (!strcmp(argv[1], "enable") ||
         !strcmp(argv[1], "disable") ||
         !strcmp(argv[1], "status") ||
+        !strcmp(argv[1], "stats") ||
+        !strcmp(argv[1], "startup-report") ||
+        !strcmp(argv[1], "adaptive") ||
+        !strcmp(argv[1], "perf") ||
+        !strcmp(argv[1], "output") ||
+        !strcmp(argv[1], "rules") ||
         !strcmp(argv[1], "quit"))
     {
-      return control_send_cmd(argv[1]);
+      /* Commands may take arguments, e.g. "mouse adaptive on" */
+      char cmd[128] = "";
+      for (int i = 1; i < argc; i++)
+      {
+        if (i > 1) strncat(cmd, " ", sizeof(cmd) - strlen(cmd) - 1);
+        strncat(cmd, argv[i], sizeof(cmd) - strlen(cmd) - 1);
+      }
+      return control_send_cmd(cmd);
+    }
+  }
+
+  motion_profile_t profile = {4, 0, 0};
+  int adaptive = 0;
+  int touch = 0;
+
+  app_state.mouse.screen_w = SCREEN_W_DEFAULT;
+  app_state.mouse.screen_h = SCREEN_H_DEFAULT;
+  app_state.mouse.scale_pct = 100;
+
+  app_state.loop = &loop_backends[0];
+  for (int i = 1; i < argc; i++)
+  {
+    if (strncmp(argv[i], "--speed=", 8) == 0)
+    {
+      profile.speed = atoi(argv[i] + 8);
+    }
+    else if (strncmp(argv[i], "--accel=", 8) == 0)
+    {
+      profile.accel = atoi(argv[i] + 8);
+    }
+    else if (strncmp(argv[i], "--max-speed=", 12) == 0)
+    {
+      profile.max_speed = atoi(argv[i] + 12);
+    }
+    else if (strcmp(argv[i], "--adaptive") == 0)
+    {
+      adaptive = 1;
+    }
+    else if (strcmp(argv[i], "--perf") == 0)
+    {
+      atomic_store(&app_state.perf.enabled, 1);
+    }
+    else if (strcmp(argv[i], "--output=touch") == 0)
+    {
+      touch = 1;
+    }
+    else if (strcmp(argv[i], "--output=pointer") == 0)
+    {
+      touch = 0;
+    }
+    else if (strncmp(argv[i], "--screen=", 9) == 0)
+    {
+      int w, h;
+      if (sscanf(argv[i] + 9, "%dx%d", &w, &h) != 2 || w < 2 || h < 2)
+      {
+        fprintf(stderr, "bad screen size: %s\n", argv[i] + 9);
+        return 1;
+      }
+      app_state.mouse.screen_w = w;
+      app_state.mouse.screen_h = h;
+    }
+    else if (strncmp(argv[i], "--pointer-scale=", 16) == 0)
+    {
+      app_state.mouse.scale_pct = atoi(argv[i] + 16);
+      if (app_state.mouse.scale_pct < 1) app_state.mouse.scale_pct = 100;
+    }
+    else if (strncmp(argv[i], "--loop=", 7) == 0)
+    {
+      const loop_backend_t *b = loop_backends;
+      while (b->name && strcmp(b->name, argv[i] + 7) != 0) b++;
+      if (!b->name)
+      {
+        fprintf(stderr, "unknown event loop: %s\n", argv[i] + 7);
+        return 1;
+      }
+      app_state.loop = b;
     }
   }
 
+  if (profile.speed < 1) profile.speed = 1;
+  motion_init(&app_state.motion, &profile);
+  atomic_store(&app_state.mouse.adaptive, adaptive);
+
+  startup_begin();
+
+  long long t = mono_us();
   log_init();
   log_message("FlipMouse starting up");
+  startup_phase("log_init", NULL, t);
+
+  /* Keep the learned gain even while adaptive mode is off */
+  adaptive_load();
 
   setup_signal_handlers();
 
+  /* The virtual mouse is created in the background while we scan */
+  t = mono_us();
+  int mouse_rc = mouse_init();
+  startup_phase("mouse_init", NULL, t);
+  if (mouse_rc != 0)
+  {
+    log_message("ERROR: Failed to initialize virtual mouse");
+    mouse_cleanup();
+    log_close();
+    return 1;
+  }
+
   if (devices_find_and_init() != 0)
   {
     log_message("ERROR: Failed to find any supported input devices");
+    mouse_cleanup();
+    devices_cleanup();
     log_close();
     return 1;
   }
 
-  if (mouse_init() != 0)
+  /* Rules are optional; a broken file is logged and leaves them off.
+     Loaded after the scan so emits are checked against the devices. */
+  if (access(RULES_FILE, F_OK) == 0)
+  {
+    char err[160];
+    t = mono_us();
+    rules_reload(NULL, err, sizeof(err));
+    startup_phase("rules", NULL, t);
+  }
+
+  t = mono_us();
+  mouse_rc = mouse_wait_ready();
+  startup_phase("mouse_wait", NULL, t);
+  if (mouse_rc != 0)
   {
     log_message("ERROR: Failed to initialize virtual mouse");
+    mouse_cleanup();
     devices_cleanup();
     log_close();
     return 1;
   }
 
+  if (touch)
+  {
+    t = mono_us();
+    if (touch_init() == 0)
+      atomic_store(&app_state.mouse.output, OUTPUT_TOUCH);
+    startup_phase("uinput", "touch", t);
+  }
+
   /* Park pointer at startup since we begin disabled */
+  t = mono_us();
   park_bottom_right();
-  write_status_file();
+  startup_phase("park", NULL, t);
 
+  t = mono_us();
   if (control_init() != 0)
     log_message("WARNING: control interface failed to init (continuing)");
+  startup_phase("control_init", NULL, t);
+
+  startup_ready();
+  write_status_file();
 
   int result = run_event_loop();
 
+  adaptive_save();
   control_cleanup();
   mouse_cleanup();
   devices_cleanup();
+  free(app_state.rules.active);
+  free(atomic_load(&app_state.rules.pending));
 
   log_message("FlipMouse shutting down");
   log_close();
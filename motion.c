@@ -0,0 +1,104 @@
+/*
+ * Arrow-key pointer motion for FlipMouse; see motion.h.
+ */
+
+#include <string.h>
+
+#include "motion.h"
+
+static int clamp(int v, int lo, int hi)
+{
+  return v < lo ? lo : (v > hi ? hi : v);
+}
+
+/* UP/DOWN and LEFT/RIGHT are adjacent in motion_dir_t */
+static int is_reversal(int a, int b)
+{
+  return a >= 0 && b >= 0 && a != b && (a >> 1) == (b >> 1);
+}
+
+void motion_init(motion_t *m, const motion_profile_t *profile)
+{
+  memset(m, 0, sizeof(*m));
+  m->profile = *profile;
+  m->gain = MOTION_GAIN_ONE;
+  m->run_dir = -1;
+  m->prev_dir = -1;
+}
+
+void motion_set_gain(motion_t *m, int gain)
+{
+  m->gain = clamp(gain, MOTION_GAIN_MIN, MOTION_GAIN_MAX);
+}
+
+int motion_base_speed(const motion_t *m)
+{
+  int speed = m->profile.speed;
+
+  if (m->adaptive)
+    speed = (speed * m->gain + MOTION_GAIN_ONE / 2) / MOTION_GAIN_ONE;
+
+  return speed < 1 ? 1 : speed;
+}
+
+/* A new run is starting in dir; judge how the previous one went */
+static void motion_learn(motion_t *m, int dir, long long t_ms)
+{
+  int gain = m->gain;
+
+  if (is_reversal(m->prev_dir, dir) &&
+      t_ms - m->prev_end_ms <= MOTION_REVERSAL_WINDOW_MS &&
+      m->prev_len >= MOTION_OVERSHOOT_MIN_RUN)
+  {
+    /* Traversal immediately walked back: too fast */
+    gain -= gain / 16;
+    m->overshoots++;
+  }
+  else if (m->prev_len >= MOTION_LONG_RUN)
+  {
+    /* Long traversal that needed no correction: could be faster */
+    gain += gain / 32;
+    m->long_runs++;
+  }
+
+  gain = clamp(gain, MOTION_GAIN_MIN, MOTION_GAIN_MAX);
+  if (gain != m->gain)
+  {
+    m->gain = gain;
+    m->dirty = 1;
+  }
+}
+
+int motion_step(motion_t *m, motion_dir_t dir, long long t_ms)
+{
+  int d = (int)dir;
+
+  if (d != m->run_dir || t_ms - m->run_last_ms > MOTION_RUN_GAP_MS)
+  {
+    if (m->run_dir >= 0)
+    {
+      m->prev_dir = m->run_dir;
+      m->prev_len = m->run_len;
+      m->prev_end_ms = m->run_last_ms;
+    }
+
+    if (m->adaptive) motion_learn(m, d, t_ms);
+
+    m->run_dir = d;
+    m->run_len = 0;
+  }
+
+  m->run_len++;
+  m->run_last_ms = t_ms;
+
+  int step = motion_base_speed(m);
+
+  if (m->profile.accel > 0)
+  {
+    step += m->profile.accel * ((m->run_len - 1) / MOTION_ACCEL_EVENTS);
+    if (m->profile.max_speed > 0 && step > m->profile.max_speed)
+      step = m->profile.max_speed;
+  }
+
+  return step;
+}
@@ -0,0 +1,79 @@
+/*
+ * Arrow-key pointer motion for FlipMouse.
+ *
+ * Pure logic with no I/O, so the offline simulator (tools/pointsim.c)
+ * drives exactly the code the daemon runs.
+ *
+ * Every arrow event (press, repeat or release) moves the pointer by one
+ * step. A step is the profile speed scaled by the adaptive gain, plus
+ * optional acceleration while the same direction keeps repeating.
+ *
+ * Adaptive mode watches for overshoot corrections: a traversal in one
+ * direction followed shortly by a move back the other way. Each correction
+ * lowers the gain a little, and long traversals that need no correction
+ * raise it, always within [MOTION_GAIN_MIN, MOTION_GAIN_MAX].
+ */
+
+#ifndef FLIPMOUSE_MOTION_H
+#define FLIPMOUSE_MOTION_H
+
+/* Gain is fixed point, MOTION_GAIN_ONE == 1.0 */
+#define MOTION_GAIN_ONE 256
+#define MOTION_GAIN_MIN 128 /* 0.5x */
+#define MOTION_GAIN_MAX 512 /* 2.0x */
+
+/* Run detection (milliseconds / events) */
+#define MOTION_RUN_GAP_MS 400        /* longer pause starts a new run */
+#define MOTION_REVERSAL_WINDOW_MS 1000
+#define MOTION_OVERSHOOT_MIN_RUN 4   /* shorter runs are fine targeting, not traversals */
+#define MOTION_LONG_RUN 12
+#define MOTION_ACCEL_EVENTS 4        /* accel adds once per this many events in a run */
+
+typedef enum
+{
+  MOTION_UP = 0,
+  MOTION_DOWN,
+  MOTION_LEFT,
+  MOTION_RIGHT
+} motion_dir_t;
+
+/* Motion profile */
+typedef struct
+{
+  int speed;     /* pixels per arrow event */
+  int accel;     /* extra pixels per MOTION_ACCEL_EVENTS in one run, 0 = off */
+  int max_speed; /* cap on the accelerated step, 0 = none */
+} motion_profile_t;
+
+typedef struct
+{
+  motion_profile_t profile;
+  int adaptive;
+  int gain;
+  int dirty; /* gain changed since the owner last persisted it */
+
+  /* current run */
+  int run_dir;
+  int run_len;
+  long long run_last_ms;
+
+  /* previous run */
+  int prev_dir;
+  int prev_len;
+  long long prev_end_ms;
+
+  unsigned overshoots;
+  unsigned long_runs;
+} motion_t;
+
+void motion_init(motion_t *m, const motion_profile_t *profile);
+
+/* Pixels to move for one arrow event in dir at time t_ms (always > 0) */
+int motion_step(motion_t *m, motion_dir_t dir, long long t_ms);
+
+/* Step size before acceleration: speed scaled by the adaptive gain */
+int motion_base_speed(const motion_t *m);
+
+void motion_set_gain(motion_t *m, int gain);
+
+#endif /* FLIPMOUSE_MOTION_H */
@@ -0,0 +1,624 @@
+/*
+ * User-defined key translation rules for FlipMouse; see rules.h.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rules.h"
+
+#ifndef KEY_FOCUS
+#define KEY_FOCUS 212
+#endif
+
+#define RULES_MAX_TOKENS 64
+#define RULES_LINE_MAX 512
+
+typedef enum
+{
+  OP_END = 0,  /* a = verdict */
+  OP_FIELD,    /* a = field | cmp << 4, c = value, b = fail target */
+  OP_DEV,      /* a = device slot, b = fail target */
+  OP_REG,      /* a = reg | cmp << 4, c = value, b = fail target */
+  OP_TIMER,    /* a = timer | TIMER_EXPIRED, b = fail target */
+  OP_EMIT,     /* a = EMIT_* | type << 2, b = code, c = value */
+  OP_SET,      /* a = reg, c = value */
+  OP_ADD,      /* a = reg, c = value */
+  OP_START,    /* a = timer, c = ms */
+  OP_CANCEL,   /* a = timer */
+  OP_MODE,     /* a = rules_mode_t */
+  OP_COUNT
+} rule_op_t;
+
+typedef enum
+{
+  FIELD_TYPE = 0,
+  FIELD_CODE,
+  FIELD_VALUE,
+  FIELD_MODE,
+  FIELD_COUNT
+} rule_field_t;
+
+typedef enum
+{
+  CMP_EQ = 0,
+  CMP_NE,
+  CMP_LT,
+  CMP_GE,
+  CMP_COUNT
+} rule_cmp_t;
+
+#define TIMER_EXPIRED 0x10
+#define EMIT_MOUSE 0x01
+#define EMIT_VALUE 0x02 /* use the event's value instead of c */
+
+typedef struct
+{
+  const char *name;
+  int value;
+} rule_name_t;
+
+#define N(x) { #x, x }
+
+static const rule_name_t type_names[] = {
+  { "syn", EV_SYN }, { "key", EV_KEY }, { "rel", EV_REL },
+  { "abs", EV_ABS }, { "msc", EV_MSC },
+};
+
+static const rule_name_t code_names[] = {
+  N(KEY_ESC), N(KEY_1), N(KEY_2), N(KEY_3), N(KEY_4), N(KEY_5),
+  N(KEY_6), N(KEY_7), N(KEY_8), N(KEY_9), N(KEY_0),
+  N(KEY_A), N(KEY_B), N(KEY_C), N(KEY_D), N(KEY_E), N(KEY_F), N(KEY_G),
+  N(KEY_H), N(KEY_I), N(KEY_J), N(KEY_K), N(KEY_L), N(KEY_M), N(KEY_N),
+  N(KEY_O), N(KEY_P), N(KEY_Q), N(KEY_R), N(KEY_S), N(KEY_T), N(KEY_U),
+  N(KEY_V), N(KEY_W), N(KEY_X), N(KEY_Y), N(KEY_Z),
+  N(KEY_ENTER), N(KEY_BACKSPACE), N(KEY_SPACE), N(KEY_TAB),
+  N(KEY_UP), N(KEY_DOWN), N(KEY_LEFT), N(KEY_RIGHT),
+  N(KEY_HOME), N(KEY_END), N(KEY_BACK), N(KEY_MENU), N(KEY_SEND),
+  N(KEY_HELP), N(KEY_F12), N(KEY_FOCUS), N(KEY_CAMERA), N(KEY_POWER),
+  N(KEY_VOLUMEUP), N(KEY_VOLUMEDOWN), N(KEY_MUTE), N(KEY_PLAYPAUSE),
+  N(KEY_NUMERIC_STAR), N(KEY_NUMERIC_POUND), N(KEY_SEARCH),
+  N(BTN_LEFT), N(BTN_RIGHT), N(BTN_MIDDLE), N(BTN_TOUCH),
+  N(REL_X), N(REL_Y), N(REL_WHEEL), N(REL_HWHEEL),
+  N(MSC_SCAN), N(SYN_REPORT),
+};
+
+#undef N
+
+typedef struct
+{
+  rules_t *r;
+  int line;
+  char *err;
+  size_t errlen;
+  rules_emit_check_t check;
+  void *ctx;
+  const char *device; /* the current rule's device="...", if any */
+} rule_compiler_t;
+
+static int fail(rule_compiler_t *rc, const char *fmt, ...)
+{
+  va_list ap;
+  int n = rc->line ? snprintf(rc->err, rc->errlen, "line %d: ", rc->line) : 0;
+
+  if (n < 0 || (size_t)n >= rc->errlen) n = 0;
+  va_start(ap, fmt);
+  vsnprintf(rc->err + n, rc->errlen - n, fmt, ap);
+  va_end(ap);
+  return -1;
+}
+
+static int parse_int(const char *s, int *out)
+{
+  char *end;
+  long v;
+
+  if (!*s) return -1;
+  v = strtol(s, &end, 0);
+  if (*end || v < INT32_MIN || v > INT32_MAX) return -1;
+  *out = (int)v;
+  return 0;
+}
+
+static int lookup(const rule_name_t *names, size_t n, const char *s, int *out)
+{
+  for (size_t i = 0; i < n; i++)
+  {
+    if (strcmp(names[i].name, s) == 0)
+    {
+      *out = names[i].value;
+      return 0;
+    }
+  }
+  return parse_int(s, out);
+}
+
+static int parse_type(const char *s, int *out)
+{
+  return lookup(type_names, sizeof(type_names) / sizeof(type_names[0]), s, out) < 0 ||
+         *out < 0 || *out > EV_MAX ? -1 : 0;
+}
+
+static int parse_code(const char *s, int *out)
+{
+  return lookup(code_names, sizeof(code_names) / sizeof(code_names[0]), s, out) < 0 ||
+         *out < 0 || *out > 0xffff ? -1 : 0;
+}
+
+/* "rN" / "tN" with N < limit */
+static int parse_index(const char *s, char prefix, int limit, int *out)
+{
+  if (s[0] != prefix || s[1] < '0' || s[1] > '9' || s[2]) return -1;
+  *out = s[1] - '0';
+  return *out < limit ? 0 : -1;
+}
+
+static int emit_insn(rule_compiler_t *rc, int op, int a, int b, int c)
+{
+  rules_t *r = rc->r;
+
+  /* Keep one slot for the final END */
+  if (r->len >= RULES_MAX_INSNS - 1)
+    return fail(rc, "program longer than %d instructions", RULES_MAX_INSNS);
+
+  r->code[r->len].op = (uint8_t)op;
+  r->code[r->len].a = (uint8_t)a;
+  r->code[r->len].b = (uint16_t)b;
+  r->code[r->len].c = c;
+  r->len++;
+  return 0;
+}
+
+static int device_slot(rule_compiler_t *rc, const char *name)
+{
+  rules_t *r = rc->r;
+
+  for (size_t i = 0; i < r->ndevices; i++)
+    if (strcmp(r->devices[i], name) == 0) return (int)i;
+
+  if (r->ndevices >= RULES_MAX_DEVICES)
+    return fail(rc, "more than %d distinct devices", RULES_MAX_DEVICES);
+  if (strlen(name) >= RULES_NAME_MAX)
+    return fail(rc, "device name too long");
+
+  strcpy(r->devices[r->ndevices], name);
+  return (int)r->ndevices++;
+}
+
+/* Split a line into tokens in place; "quoted strings" keep their spaces */
+static int tokenize(rule_compiler_t *rc, char *s, char **tok, int max)
+{
+  int n = 0;
+
+  while (*s)
+  {
+    while (*s == ' ' || *s == '\t' || *s == '\r') s++;
+    if (!*s || *s == '#') break;
+    if (n == max) return fail(rc, "too many tokens");
+
+    tok[n++] = s;
+    while (*s && *s != ' ' && *s != '\t' && *s != '\r')
+    {
+      if (*s == '"')
+      {
+        char *close = strchr(s + 1, '"');
+        if (!close) return fail(rc, "unterminated quote");
+        s = close;
+      }
+      s++;
+    }
+    if (*s) *s++ = '\0';
+  }
+  return n;
+}
+
+/* Remove the quotes from device="..." in place */
+static char *unquote(char *s)
+{
+  size_t n = strlen(s);
+
+  if (n >= 2 && s[0] == '"' && s[n - 1] == '"')
+  {
+    s[n - 1] = '\0';
+    return s + 1;
+  }
+  return s;
+}
+
+static int compile_cond(rule_compiler_t *rc, char *tok)
+{
+  char *op = tok + strcspn(tok, "!<>=");
+  char *val;
+  int cmp, v, idx;
+
+  if (op == tok || !*op) return fail(rc, "bad condition '%s'", tok);
+
+  if (op[0] == '=') cmp = CMP_EQ, val = op + 1;
+  else if (op[0] == '<') cmp = CMP_LT, val = op + 1;
+  else if (op[1] != '=') return fail(rc, "bad condition '%s'", tok);
+  else cmp = op[0] == '!' ? CMP_NE : CMP_GE, val = op + 2;
+  *op = '\0';
+
+  /* Fail targets are patched once the rule's actions are known */
+  if (tok[0] == 'r' && parse_index(tok, 'r', RULES_REGS, &idx) == 0)
+  {
+    if (parse_int(val, &v) < 0) return fail(rc, "bad number '%s'", val);
+    return emit_insn(rc, OP_REG, idx | cmp << 4, 0, v);
+  }
+
+  if (cmp != CMP_EQ) return fail(rc, "only registers support '<', '>=' and '!='");
+
+  if (strcmp(tok, "key") == 0)
+  {
+    if (parse_code(val, &v) < 0) return fail(rc, "unknown key '%s'", val);
+    if (emit_insn(rc, OP_FIELD, FIELD_TYPE, 0, EV_KEY) < 0) return -1;
+    return emit_insn(rc, OP_FIELD, FIELD_CODE, 0, v);
+  }
+  if (strcmp(tok, "type") == 0)
+  {
+    if (parse_type(val, &v) < 0) return fail(rc, "unknown type '%s'", val);
+    return emit_insn(rc, OP_FIELD, FIELD_TYPE, 0, v);
+  }
+  if (strcmp(tok, "code") == 0)
+  {
+    if (parse_code(val, &v) < 0) return fail(rc, "unknown code '%s'", val);
+    return emit_insn(rc, OP_FIELD, FIELD_CODE, 0, v);
+  }
+  if (strcmp(tok, "value") == 0)
+  {
+    if (parse_int(val, &v) < 0) return fail(rc, "bad number '%s'", val);
+    return emit_insn(rc, OP_FIELD, FIELD_VALUE, 0, v);
+  }
+  if (strcmp(tok, "mode") == 0)
+  {
+    if (strcmp(val, "mouse") != 0 && strcmp(val, "keys") != 0)
+      return fail(rc, "mode must be mouse or keys");
+    return emit_insn(rc, OP_FIELD, FIELD_MODE, 0, val[0] == 'm');
+  }
+  if (strcmp(tok, "device") == 0)
+  {
+    int slot = device_slot(rc, unquote(val));
+    if (slot < 0) return -1;
+    rc->device = rc->r->devices[slot];
+    return emit_insn(rc, OP_DEV, slot, 0, 0);
+  }
+  if (strcmp(tok, "after") == 0 || strcmp(tok, "before") == 0)
+  {
+    if (parse_index(val, 't', RULES_TIMERS, &idx) < 0) return fail(rc, "bad timer '%s'", val);
+    return emit_insn(rc, OP_TIMER, idx | (tok[0] == 'a' ? TIMER_EXPIRED : 0), 0, 0);
+  }
+
+  return fail(rc, "unknown condition '%s'", tok);
+}
+
+/* Compile the action starting at tok[0]; returns tokens consumed */
+static int compile_action(rule_compiler_t *rc, char **tok, int n, int *verdict)
+{
+  int idx, v;
+
+  if (strcmp(tok[0], "pass") == 0 || strcmp(tok[0], "drop") == 0)
+  {
+    *verdict = tok[0][0] == 'd' ? RULES_DROP : RULES_PASS;
+    return 1;
+  }
+
+  if (strcmp(tok[0], "emit") == 0)
+  {
+    int a, type, code;
+
+    if (n < 5) return fail(rc, "emit needs: dev|mouse TYPE CODE VALUE");
+    if (strcmp(tok[1], "mouse") == 0) a = EMIT_MOUSE;
+    else if (strcmp(tok[1], "dev") == 0) a = 0;
+    else return fail(rc, "emit target must be dev or mouse");
+
+    if (parse_type(tok[2], &type) < 0) return fail(rc, "unknown type '%s'", tok[2]);
+    if (parse_code(tok[3], &code) < 0) return fail(rc, "unknown code '%s'", tok[3]);
+    if (rc->check)
+    {
+      const char *target = rc->check(rc->ctx, a & EMIT_MOUSE, rc->device, type, code);
+      if (target) return fail(rc, "%s cannot send %s %s", target, tok[2], tok[3]);
+    }
+    if (strcmp(tok[4], "$value") == 0)
+    {
+      a |= EMIT_VALUE;
+      v = 0;
+    }
+    else if (parse_int(tok[4], &v) < 0)
+    {
+      return fail(rc, "bad number '%s'", tok[4]);
+    }
+    return emit_insn(rc, OP_EMIT, a | type << 2, code, v) < 0 ? -1 : 5;
+  }
+
+  if (strcmp(tok[0], "set") == 0 || strcmp(tok[0], "add") == 0)
+  {
+    if (n < 3 || parse_index(tok[1], 'r', RULES_REGS, &idx) < 0)
+      return fail(rc, "%s needs: rN VALUE", tok[0]);
+    if (parse_int(tok[2], &v) < 0) return fail(rc, "bad number '%s'", tok[2]);
+    return emit_insn(rc, tok[0][0] == 's' ? OP_SET : OP_ADD, idx, 0, v) < 0 ? -1 : 3;
+  }
+
+  if (strcmp(tok[0], "timer") == 0)
+  {
+    if (n < 3 || parse_index(tok[1], 't', RULES_TIMERS, &idx) < 0)
+      return fail(rc, "timer needs: tN MS");
+    if (parse_int(tok[2], &v) < 0 || v <= 0) return fail(rc, "bad timeout '%s'", tok[2]);
+    return emit_insn(rc, OP_START, idx, 0, v) < 0 ? -1 : 3;
+  }
+
+  if (strcmp(tok[0], "cancel") == 0)
+  {
+    if (n < 2 || parse_index(tok[1], 't', RULES_TIMERS, &idx) < 0)
+      return fail(rc, "cancel needs: tN");
+    return emit_insn(rc, OP_CANCEL, idx, 0, 0) < 0 ? -1 : 2;
+  }
+
+  if (strcmp(tok[0], "mode") == 0)
+  {
+    if (n < 2) return fail(rc, "mode needs: mouse|keys|toggle");
+    if (strcmp(tok[1], "mouse") == 0) v = RULES_MODE_MOUSE;
+    else if (strcmp(tok[1], "keys") == 0) v = RULES_MODE_KEYS;
+    else if (strcmp(tok[1], "toggle") == 0) v = RULES_MODE_TOGGLE;
+    else return fail(rc, "mode needs: mouse|keys|toggle");
+    return emit_insn(rc, OP_MODE, v, 0, 0) < 0 ? -1 : 2;
+  }
+
+  return fail(rc, "unknown action '%s'", tok[0]);
+}
+
+static int compile_rule(rule_compiler_t *rc, char **tok, int n)
+{
+  rules_t *r = rc->r;
+  size_t first = r->len;
+  int i = 0, verdict = RULES_PASS;
+
+  rc->device = NULL;
+  if (strcmp(tok[0], "when") == 0) i++;
+
+  for (; i < n && strcmp(tok[i], "do") != 0; i++)
+    if (compile_cond(rc, tok[i]) < 0) return -1;
+
+  if (i == n) return fail(rc, "missing 'do'");
+  if (++i == n) return fail(rc, "no actions after 'do'");
+
+  while (i < n)
+  {
+    int used = compile_action(rc, tok + i, n - i, &verdict);
+    if (used < 0) return -1;
+    i += used;
+  }
+
+  if (emit_insn(rc, OP_END, verdict, 0, 0) < 0) return -1;
+
+  /* A failed condition skips to the next rule */
+  for (size_t pc = first; pc < r->len; pc++)
+  {
+    int op = r->code[pc].op;
+    if (op == OP_FIELD || op == OP_DEV || op == OP_REG || op == OP_TIMER)
+      r->code[pc].b = (uint16_t)r->len;
+  }
+
+  r->nrules++;
+  return 0;
+}
+
+static int is_cond(int op)
+{
+  return op == OP_FIELD || op == OP_DEV || op == OP_REG || op == OP_TIMER;
+}
+
+/*
+ * Check the program independently of the compiler: operands in range,
+ * every jump strictly forward and every path ending in END. Then the
+ * longest path (and the most emits on any path) follow from one backward
+ * pass, since the program is a DAG in instruction order.
+ */
+static int rules_verify(rule_compiler_t *rc)
+{
+  rules_t *r = rc->r;
+  unsigned cost[RULES_MAX_INSNS], emits[RULES_MAX_INSNS];
+
+  if (r->len == 0 || r->len > RULES_MAX_INSNS || r->code[r->len - 1].op != OP_END)
+    return fail(rc, "verify: program must end in END");
+
+  for (size_t pc = 0; pc < r->len; pc++)
+  {
+    const rule_insn_t *in = &r->code[pc];
+    int idx = in->a & 0x0f;
+
+    switch (in->op)
+    {
+    case OP_END:
+      if (in->a > RULES_DROP) return fail(rc, "verify: bad verdict at %zu", pc);
+      break;
+    case OP_FIELD:
+      if (idx >= FIELD_COUNT || in->a >> 4 != CMP_EQ) return fail(rc, "verify: bad field at %zu", pc);
+      break;
+    case OP_DEV:
+      if (in->a >= r->ndevices) return fail(rc, "verify: bad device at %zu", pc);
+      break;
+    case OP_REG:
+      if (idx >= RULES_REGS || in->a >> 4 >= CMP_COUNT) return fail(rc, "verify: bad register at %zu", pc);
+      break;
+    case OP_TIMER:
+      if ((in->a & ~TIMER_EXPIRED) >= RULES_TIMERS) return fail(rc, "verify: bad timer at %zu", pc);
+      break;
+    case OP_EMIT:
+      if (in->a >> 2 > EV_MAX) return fail(rc, "verify: bad emit at %zu", pc);
+      break;
+    case OP_SET:
+    case OP_ADD:
+      if (in->a >= RULES_REGS) return fail(rc, "verify: bad register at %zu", pc);
+      break;
+    case OP_START:
+    case OP_CANCEL:
+      if (in->a >= RULES_TIMERS) return fail(rc, "verify: bad timer at %zu", pc);
+      break;
+    case OP_MODE:
+      if (in->a > RULES_MODE_TOGGLE) return fail(rc, "verify: bad mode at %zu", pc);
+      break;
+    default:
+      return fail(rc, "verify: bad opcode %d at %zu", in->op, pc);
+    }
+
+    if (is_cond(in->op) && (in->b <= pc || in->b >= r->len))
+      return fail(rc, "verify: jump at %zu is not forward", pc);
+  }
+
+  for (size_t pc = r->len; pc-- > 0;)
+  {
+    const rule_insn_t *in = &r->code[pc];
+
+    if (in->op == OP_END)
+    {
+      cost[pc] = 1;
+      emits[pc] = 0;
+      continue;
+    }
+
+    cost[pc] = 1 + cost[pc + 1];
+    emits[pc] = (in->op == OP_EMIT) + emits[pc + 1];
+    if (is_cond(in->op))
+    {
+      if (cost[in->b] + 1 > cost[pc]) cost[pc] = cost[in->b] + 1;
+      if (emits[in->b] > emits[pc]) emits[pc] = emits[in->b];
+    }
+  }
+
+  if (emits[0] > RULES_MAX_EMITS)
+    return fail(rc, "verify: a rule emits more than %d events", RULES_MAX_EMITS);
+
+  r->worst_case = cost[0];
+  return 0;
+}
+
+int rules_compile(rules_t *r, const char *text, rules_emit_check_t check, void *ctx,
+                  char *err, size_t errlen)
+{
+  rule_compiler_t rc = { r, 0, err, errlen, check, ctx, NULL };
+  char line[RULES_LINE_MAX];
+  char *tok[RULES_MAX_TOKENS];
+
+  memset(r, 0, sizeof(*r));
+  if (errlen) err[0] = '\0';
+
+  while (*text)
+  {
+    const char *eol = strchr(text, '\n');
+    size_t n = eol ? (size_t)(eol - text) : strlen(text);
+
+    rc.line++;
+    if (n >= sizeof(line)) return fail(&rc, "line too long");
+    memcpy(line, text, n);
+    line[n] = '\0';
+    text += eol ? n + 1 : n;
+
+    int ntok = tokenize(&rc, line, tok, RULES_MAX_TOKENS);
+    if (ntok < 0) return -1;
+    if (ntok > 0 && compile_rule(&rc, tok, ntok) < 0) return -1;
+  }
+
+  /* No rule matched: built-in handling */
+  rc.line = 0;
+  r->code[r->len].op = OP_END;
+  r->code[r->len].a = RULES_PASS;
+  r->len++;
+
+  return rules_verify(&rc);
+}
+
+unsigned rules_device_mask(const rules_t *r, const char *name)
+{
+  unsigned mask = 0;
+
+  for (size_t i = 0; i < r->ndevices; i++)
+    if (strcmp(r->devices[i], name) == 0) mask |= 1u << i;
+
+  return mask;
+}
+
+static int compare(int cmp, int x, int v)
+{
+  switch (cmp)
+  {
+  case CMP_NE: return x != v;
+  case CMP_LT: return x < v;
+  case CMP_GE: return x >= v;
+  default: return x == v;
+  }
+}
+
+void rules_run(rules_t *r, const struct input_event *ev, unsigned dev_mask,
+               int mouse_mode, long long now_ms, rules_result_t *res)
+{
+  size_t pc = 0;
+
+  res->verdict = RULES_PASS;
+  res->mode = RULES_MODE_KEEP;
+  res->nemits = 0;
+
+  /* Jumps are verified forward-only, so this runs at most len steps */
+  while (pc < r->len)
+  {
+    const rule_insn_t *in = &r->code[pc];
+    int idx = in->a & 0x0f, ok = 1;
+
+    switch (in->op)
+    {
+    case OP_END:
+      res->verdict = in->a;
+      return;
+    case OP_FIELD:
+    {
+      int x = idx == FIELD_TYPE ? ev->type : idx == FIELD_CODE ? ev->code :
+              idx == FIELD_VALUE ? ev->value : mouse_mode;
+      ok = x == in->c;
+      break;
+    }
+    case OP_DEV:
+      ok = (dev_mask >> in->a) & 1;
+      break;
+    case OP_REG:
+      ok = compare(in->a >> 4, r->regs[idx], in->c);
+      break;
+    case OP_TIMER:
+    {
+      long long deadline = r->timers[in->a & ~TIMER_EXPIRED];
+      ok = deadline != 0 && ((in->a & TIMER_EXPIRED) ? now_ms >= deadline : now_ms < deadline);
+      break;
+    }
+    case OP_EMIT:
+      if (res->nemits < RULES_MAX_EMITS)
+      {
+        rules_emit_t *e = &res->emits[res->nemits++];
+        memset(e, 0, sizeof(*e));
+        e->to_mouse = in->a & EMIT_MOUSE;
+        e->ev.input_event_sec = ev->input_event_sec;
+        e->ev.input_event_usec = ev->input_event_usec;
+        e->ev.type = in->a >> 2;
+        e->ev.code = in->b;
+        e->ev.value = (in->a & EMIT_VALUE) ? ev->value : in->c;
+      }
+      break;
+    case OP_SET:
+      r->regs[in->a] = in->c;
+      break;
+    case OP_ADD:
+      r->regs[in->a] = (int)((unsigned)r->regs[in->a] + (unsigned)in->c);
+      break;
+    case OP_START:
+      r->timers[in->a] = now_ms + in->c;
+      break;
+    case OP_CANCEL:
+      r->timers[in->a] = 0;
+      break;
+    case OP_MODE:
+      res->mode = in->a;
+      break;
+    }
+
+    pc = ok ? pc + 1 : in->b;
+  }
+}
@@ -0,0 +1,121 @@
+/*
+ * User-defined key translation rules for FlipMouse.
+ *
+ * Rules are plain text, one per line, compiled once at load into a small
+ * bytecode program that runs for every input event before the built-in
+ * handling. Jumps only go forward, so every instruction runs at most once
+ * per event; the verifier checks that and computes the worst-case number
+ * of instructions per event.
+ *
+ *   # comment
+ *   when <condition>... do <action>...
+ *
+ * Conditions (all must hold):
+ *   key=NAME|N          EV_KEY with that code
+ *   type=key|rel|abs|msc|N   code=NAME|N   value=N
+ *   mode=mouse|keys     current mode
+ *   device="name"       event came from that device
+ *   rN=V rN!=V rN<V rN>=V   register compare (r0..r7)
+ *   after=tN            timer tN has expired
+ *   before=tN           timer tN is running
+ *
+ * Actions (in order):
+ *   emit dev|mouse TYPE CODE VALUE|$value   send an event (plus SYN);
+ *                       the target must support the code
+ *   set rN V            store V in register rN
+ *   add rN V            add V to register rN
+ *   timer tN MS         start (or restart) timer tN
+ *   cancel tN
+ *   mode mouse|keys|toggle
+ *   pass | drop         continue with the built-in handling, or swallow
+ *
+ * The first rule whose conditions hold runs; the event is then dropped if
+ * it says drop, otherwise handled as usual. Timers are deadlines checked by
+ * after=/before= when the next event arrives; they never fire on their own.
+ */
+
+#ifndef FLIPMOUSE_RULES_H
+#define FLIPMOUSE_RULES_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/input.h>
+
+#define RULES_REGS 8
+#define RULES_TIMERS 4
+#define RULES_MAX_INSNS 256
+#define RULES_MAX_DEVICES 8
+#define RULES_MAX_EMITS 8 /* per event */
+#define RULES_NAME_MAX 80
+
+/* One instruction; conditions jump to b when they do not hold */
+typedef struct
+{
+  uint8_t op;
+  uint8_t a;
+  uint16_t b;
+  int32_t c;
+} rule_insn_t;
+
+typedef struct
+{
+  rule_insn_t code[RULES_MAX_INSNS];
+  size_t len;
+  size_t nrules;
+  unsigned worst_case; /* instructions on the longest path */
+
+  char devices[RULES_MAX_DEVICES][RULES_NAME_MAX];
+  size_t ndevices;
+
+  /* runtime state */
+  int regs[RULES_REGS];
+  long long timers[RULES_TIMERS]; /* deadline in ms, 0 = idle */
+} rules_t;
+
+typedef enum
+{
+  RULES_PASS = 0,
+  RULES_DROP
+} rules_verdict_t;
+
+typedef enum
+{
+  RULES_MODE_KEEP = 0,
+  RULES_MODE_KEYS,
+  RULES_MODE_MOUSE,
+  RULES_MODE_TOGGLE
+} rules_mode_t;
+
+typedef struct
+{
+  int to_mouse;
+  struct input_event ev;
+} rules_emit_t;
+
+typedef struct
+{
+  rules_verdict_t verdict;
+  rules_mode_t mode;
+  size_t nemits;
+  rules_emit_t emits[RULES_MAX_EMITS];
+} rules_result_t;
+
+/*
+ * Asks whether an emit target can send type/code; device is the rule's
+ * device="..." or NULL. Returns NULL if it can, else the name of the
+ * target that cannot (uinput silently drops codes it never enabled).
+ */
+typedef const char *(*rules_emit_check_t)(void *ctx, int to_mouse, const char *device,
+                                          int type, int code);
+
+/* Compile and verify rule text; on error returns -1 with a message naming the line */
+int rules_compile(rules_t *r, const char *text, rules_emit_check_t check, void *ctx,
+                  char *err, size_t errlen);
+
+/* Bit i is set when name matches the rules' i-th device="..." */
+unsigned rules_device_mask(const rules_t *r, const char *name);
+
+void rules_run(rules_t *r, const struct input_event *ev, unsigned dev_mask,
+               int mouse_mode, long long now_ms, rules_result_t *res);
+
+#endif /* FLIPMOUSE_RULES_H */
@@ -0,0 +1,848 @@
+/*
+ * bench - control-plane load generator and input latency benchmark
+ *
+ * Runs on the device next to the daemon. It creates a fake keyboard
+ * ("FlipMouse Bench Keyboard", listed in supported_devices) and injects
+ * arrow presses and releases at a fixed rate with mouse mode on. Each
+ * injected frame turns into one REL_X frame on "FlipMouse Virtual Mouse",
+ * which is read back to get the end-to-end latency.
+ *
+ * The daemon only scans for keyboards at startup, so it has to be started
+ * after the bench keyboard exists: either let bench start it (--daemon) or
+ * restart it by hand when bench asks.
+ *
+ * Two phases of --duration seconds each:
+ *   idle    input injection only
+ *   loaded  input injection while --clients threads hammer the control
+ *           socket with the --cmds mix, one connection per command like
+ *           `mouse <command>`
+ *
+ * It reports command round-trip percentiles and input latency for both
+ * phases, plus the daemon's own `stats` line.
+ *
+ * --storm=RATE replaces both phases with an event storm of RATE events/s:
+ * arrow presses, autorepeats and releases written in 1ms batches. Every
+ * 500ms the storm pauses behind a toggle tap (KEY_HELP) and bench times how
+ * long the daemon takes to park the pointer, i.e. to act on the toggle
+ * behind the backlog. A second tap turns mouse mode back on before the
+ * storm resumes, so no storm keys reach apps. The daemon's overload
+ * counters (shed repeats, merged motion, kernel drops) are printed at the
+ * end.
+ *
+ * Build: ./make-mouse (writes build/bench next to build/mouse)
+ *
+ * Example:
+ *   killall mouse; ./bench --daemon=/data/adb/modules/DumbMouse/mouse --clients=8 --rate=200
+ *
+ * With a laptop keyboard attached the daemon uses the laptop keymap; pass
+ * --laptop so the injected scancodes match.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <linux/uinput.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define DEV_INPUT "/dev/input"
+#define DEV_UINPUT "/dev/uinput"
+#define CONTROL_SOCK "/data/local/tmp/flipmouse/sock"
+#define BENCH_NAME "FlipMouse Bench Keyboard"
+#define MOUSE_NAME "FlipMouse Virtual Mouse"
+
+#define MAX_CMDS 16
+#define MAX_ARGS 16
+#define REPLY_MAX 4096
+
+/* Keypad (mtk-kpd) and laptop (AT) scancodes, see the daemon's keymaps */
+#define SCAN_RIGHT_KEYPAD 34
+#define SCAN_LEFT_KEYPAD 19
+#define SCAN_RIGHT_LAPTOP 205
+#define SCAN_LEFT_LAPTOP 203
+
+/* Daemon's park_bottom_right() slams REL_X/REL_Y by PARK_STEP */
+#define PARK_STEP 200
+#define STORM_CYCLE 20       /* press, 8 repeats, release; then the other way */
+#define STORM_BATCH_MAX 4096 /* frames per write() */
+
+/* Growable list of microsecond samples */
+typedef struct
+{
+  long long *v;
+  size_t n;
+  size_t cap;
+} samples_t;
+
+typedef struct
+{
+  pthread_t thread;
+  int id;
+  samples_t rtt;
+  unsigned errors;
+} client_t;
+
+/* Options */
+typedef struct
+{
+  const char *sock;
+  const char *daemon;
+  char *daemon_args[MAX_ARGS];
+  int ndaemon_args;
+  int clients;
+  int rate;     /* injected frames per second */
+  int duration; /* seconds per phase */
+  int laptop;
+  int storm;    /* events per second, 0 = off */
+  const char *cmds[MAX_CMDS];
+  int ncmds;
+} bench_opts_t;
+
+static bench_opts_t opts = {CONTROL_SOCK, NULL, {0}, 0, 4, 100, 10, 0, 0, {0}, 0};
+
+/* Injection / readback state */
+static long long *inject_us;   /* send time per injected frame */
+static long long *latency_us;  /* readback latency per frame, -1 = not seen */
+static size_t inject_cap;
+static atomic_size_t injected;
+static atomic_size_t matched;
+static atomic_uint extra;      /* REL_X frames with no injection behind them */
+static atomic_int reading = 1;
+static atomic_int loading = 0;
+
+/* Storm state */
+static atomic_int storming = 0;
+static atomic_int storm_paused = 0;
+static atomic_int toggle_req = 0;
+static atomic_llong toggle_pending_us; /* tap sent, park not seen yet */
+static atomic_ullong storm_events;
+static atomic_ullong mouse_frames;
+static samples_t toggle_lat;           /* written by the reader thread */
+
+/* --- Helpers --- */
+
+static long long mono_us(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static void samples_add(samples_t *s, long long v)
+{
+  if (s->n == s->cap)
+  {
+    size_t cap = s->cap ? s->cap * 2 : 1024;
+    long long *nv = realloc(s->v, cap * sizeof(*nv));
+    if (!nv) return;
+    s->v = nv;
+    s->cap = cap;
+  }
+  s->v[s->n++] = v;
+}
+
+static int cmp_ll(const void *a, const void *b)
+{
+  long long x = *(const long long *)a;
+  long long y = *(const long long *)b;
+  return (x > y) - (x < y);
+}
+
+/* Sorts s in place */
+static void samples_print(const char *label, samples_t *s)
+{
+  if (!s->n)
+  {
+    printf("%s n=0\n", label);
+    return;
+  }
+
+  qsort(s->v, s->n, sizeof(s->v[0]), cmp_ll);
+  printf("%s n=%zu p50_us=%lld p90_us=%lld p99_us=%lld max_us=%lld\n",
+         label, s->n,
+         s->v[s->n * 50 / 100],
+         s->v[s->n * 90 / 100],
+         s->v[s->n * 99 / 100],
+         s->v[s->n - 1]);
+}
+
+/* --- Control socket client --- */
+
+/* One command on a fresh connection; returns reply length or -1 */
+static int ctl_request(const char *cmd, char *reply, size_t len)
+{
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) return -1;
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, opts.sock, sizeof(addr.sun_path) - 1);
+
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+  {
+    close(fd);
+    return -1;
+  }
+
+  char line[128];
+  int n = snprintf(line, sizeof(line), "%s\n", cmd);
+  if (write(fd, line, (size_t)n) != n)
+  {
+    close(fd);
+    return -1;
+  }
+
+  size_t got = 0;
+  ssize_t r;
+  while ((r = read(fd, reply + got, len - 1 - got)) > 0)
+  {
+    got += (size_t)r;
+    if (got == len - 1) break;
+  }
+  reply[got] = '\0';
+
+  close(fd);
+  return r < 0 ? -1 : (int)got;
+}
+
+static void *client_thread(void *arg)
+{
+  client_t *c = (client_t *)arg;
+  char reply[REPLY_MAX];
+  int i = c->id;
+
+  while (atomic_load(&loading))
+  {
+    const char *cmd = opts.cmds[i++ % opts.ncmds];
+    long long t = mono_us();
+
+    /* "err busy" and friends are rejections, not round trips */
+    if (ctl_request(cmd, reply, sizeof(reply)) <= 0 || strncmp(reply, "err", 3) == 0)
+      c->errors++;
+    else
+      samples_add(&c->rtt, mono_us() - t);
+  }
+
+  return NULL;
+}
+
+/* --- Fake keyboard and virtual mouse readback --- */
+
+static int bench_keyboard_create(void)
+{
+  int fd = open(DEV_UINPUT, O_WRONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    perror("open(" DEV_UINPUT ")");
+    return -1;
+  }
+
+  ioctl(fd, UI_SET_EVBIT, EV_KEY);
+  ioctl(fd, UI_SET_EVBIT, EV_MSC);
+  ioctl(fd, UI_SET_MSCBIT, MSC_SCAN);
+  ioctl(fd, UI_SET_KEYBIT, KEY_LEFT);
+  ioctl(fd, UI_SET_KEYBIT, KEY_RIGHT);
+  ioctl(fd, UI_SET_KEYBIT, KEY_HELP); /* toggle, for --storm */
+
+  struct uinput_setup setup;
+  memset(&setup, 0, sizeof(setup));
+  setup.id.bustype = BUS_VIRTUAL;
+  strncpy(setup.name, BENCH_NAME, UINPUT_MAX_NAME_SIZE - 1);
+
+  if (ioctl(fd, UI_DEV_SETUP, &setup) < 0 || ioctl(fd, UI_DEV_CREATE) < 0)
+  {
+    perror("uinput create");
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+/* Opens the daemon's virtual mouse for reading, with monotonic timestamps */
+static int mouse_open(void)
+{
+  DIR *dir = opendir(DEV_INPUT);
+  struct dirent *file;
+  int found = -1;
+
+  if (!dir) return -1;
+
+  while (found < 0 && (file = readdir(dir)) != NULL)
+  {
+    char path[300];
+    char name[80] = "";
+
+    if (strncmp(file->d_name, "event", 5) != 0) continue;
+    snprintf(path, sizeof(path), "%s/%s", DEV_INPUT, file->d_name);
+
+    int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) continue;
+
+    if (ioctl(fd, EVIOCGNAME(sizeof(name)), name) >= 0 && strcmp(name, MOUSE_NAME) == 0)
+    {
+      int clk = CLOCK_MONOTONIC;
+      ioctl(fd, EVIOCSCLOCKID, &clk);
+      found = fd;
+    }
+    else
+    {
+      close(fd);
+    }
+  }
+
+  closedir(dir);
+  return found;
+}
+
+static void mouse_drain(int fd)
+{
+  struct input_event evs[64];
+  while (read(fd, evs, sizeof(evs)) > 0)
+    ;
+}
+
+/* Storm readback: counts frames and spots the park after a toggle tap */
+static void reader_storm(const struct input_event *evs, size_t n)
+{
+  static int park_x, park_y;
+
+  for (size_t i = 0; i < n; i++)
+  {
+    const struct input_event *ev = &evs[i];
+
+    if (ev->type == EV_REL && ev->code == REL_X) park_x = ev->value == PARK_STEP;
+    if (ev->type == EV_REL && ev->code == REL_Y) park_y = ev->value == PARK_STEP;
+    if (ev->type != EV_SYN || ev->code != SYN_REPORT) continue;
+
+    atomic_fetch_add(&mouse_frames, 1);
+
+    long long sent = atomic_load(&toggle_pending_us);
+    if (park_x && park_y && sent)
+    {
+      long long t = (long long)ev->input_event_sec * 1000000LL + ev->input_event_usec;
+      samples_add(&toggle_lat, t - sent);
+      atomic_store(&toggle_pending_us, 0);
+    }
+    park_x = park_y = 0;
+  }
+}
+
+static void *reader_thread(void *arg)
+{
+  int fd = *(int *)arg;
+  struct pollfd pfd = {fd, POLLIN, 0};
+  struct input_event evs[64];
+
+  while (atomic_load(&reading))
+  {
+    if (poll(&pfd, 1, 100) <= 0) continue;
+
+    ssize_t r = read(fd, evs, sizeof(evs));
+    if (r <= 0) continue;
+
+    if (atomic_load(&storming))
+    {
+      reader_storm(evs, (size_t)r / sizeof(evs[0]));
+      continue;
+    }
+
+    for (size_t i = 0; i < (size_t)r / sizeof(evs[0]); i++)
+    {
+      if (evs[i].type != EV_REL || evs[i].code != REL_X) continue;
+
+      size_t k = atomic_load(&matched);
+      if (k >= atomic_load(&injected))
+      {
+        atomic_fetch_add(&extra, 1);
+        continue;
+      }
+
+      long long t = (long long)evs[i].input_event_sec * 1000000LL + evs[i].input_event_usec;
+      latency_us[k] = t - inject_us[k];
+      atomic_store(&matched, k + 1);
+    }
+  }
+
+  return NULL;
+}
+
+/* One arrow frame: MSC_SCAN + key + SYN. Alternates right/left pairs so the pointer stays put. */
+static int inject_frame(int kfd, size_t seq)
+{
+  int right = (seq / 2) % 2 == 0;
+  int scan = opts.laptop ? (right ? SCAN_RIGHT_LAPTOP : SCAN_LEFT_LAPTOP)
+                         : (right ? SCAN_RIGHT_KEYPAD : SCAN_LEFT_KEYPAD);
+  struct input_event evs[3];
+
+  memset(evs, 0, sizeof(evs));
+  evs[0].type = EV_MSC;
+  evs[0].code = MSC_SCAN;
+  evs[0].value = scan;
+  evs[1].type = EV_KEY;
+  evs[1].code = right ? KEY_RIGHT : KEY_LEFT;
+  evs[1].value = seq % 2 == 0; /* press, then release */
+  evs[2].type = EV_SYN;
+  evs[2].code = SYN_REPORT;
+
+  inject_us[seq] = mono_us();
+  atomic_store(&injected, seq + 1);
+  return write(kfd, evs, sizeof(evs)) == (ssize_t)sizeof(evs) ? 0 : -1;
+}
+
+/* Injects for duration_s at opts.rate; returns the first sequence number of the phase */
+static size_t inject_phase(int kfd, int duration_s)
+{
+  size_t first = atomic_load(&injected);
+  size_t count = (size_t)opts.rate * (size_t)duration_s;
+  long long period_ns = 1000000000LL / opts.rate;
+  struct timespec next;
+
+  clock_gettime(CLOCK_MONOTONIC, &next);
+
+  for (size_t i = 0; i < count && first + i < inject_cap; i++)
+  {
+    next.tv_nsec += period_ns;
+    while (next.tv_nsec >= 1000000000L)
+    {
+      next.tv_nsec -= 1000000000L;
+      next.tv_sec++;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+    if (inject_frame(kfd, first + i) < 0)
+    {
+      perror("inject");
+      break;
+    }
+  }
+
+  /* Let the last frames come back */
+  usleep(200 * 1000);
+  return first;
+}
+
+static void phase_report(const char *name, size_t first, size_t end)
+{
+  samples_t s = {0};
+  size_t lost = 0;
+  char label[64];
+  char reply[REPLY_MAX];
+
+  for (size_t k = first; k < end; k++)
+  {
+    if (k < atomic_load(&matched))
+      samples_add(&s, latency_us[k]);
+    else
+      lost++;
+  }
+
+  snprintf(label, sizeof(label), "%-7s input  ", name);
+  samples_print(label, &s);
+  if (lost) printf("%-7s input   lost=%zu\n", name, lost);
+  free(s.v);
+
+  if (ctl_request("stats", reply, sizeof(reply)) > 0)
+    printf("%-7s daemon  %s", name, reply);
+  ctl_request("stats reset", reply, sizeof(reply));
+}
+
+/* --- Event storm --- */
+
+static void storm_fill(struct input_event *evs, unsigned long long k)
+{
+  unsigned idx = (unsigned)(k % STORM_CYCLE);
+  int right = idx < STORM_CYCLE / 2;
+  unsigned pos = idx % (STORM_CYCLE / 2);
+  int scan = opts.laptop ? (right ? SCAN_RIGHT_LAPTOP : SCAN_LEFT_LAPTOP)
+                         : (right ? SCAN_RIGHT_KEYPAD : SCAN_LEFT_KEYPAD);
+
+  memset(evs, 0, 3 * sizeof(*evs));
+  evs[0].type = EV_MSC;
+  evs[0].code = MSC_SCAN;
+  evs[0].value = scan;
+  evs[1].type = EV_KEY;
+  evs[1].code = right ? KEY_RIGHT : KEY_LEFT;
+  evs[1].value = pos == 0 ? 1 : (pos == STORM_CYCLE / 2 - 1 ? 0 : 2);
+  evs[2].type = EV_SYN;
+  evs[2].code = SYN_REPORT;
+}
+
+/* Toggle tap: press and release in one write, so it is never held too long */
+static void storm_toggle(int kfd)
+{
+  struct input_event evs[4];
+
+  memset(evs, 0, sizeof(evs));
+  evs[0].type = EV_KEY;
+  evs[0].code = KEY_HELP;
+  evs[0].value = 1;
+  evs[1].type = EV_SYN;
+  evs[1].code = SYN_REPORT;
+  evs[2] = evs[0];
+  evs[2].value = 0;
+  evs[3] = evs[1];
+
+  atomic_store(&toggle_pending_us, mono_us());
+  if (write(kfd, evs, sizeof(evs)) != (ssize_t)sizeof(evs)) perror("toggle");
+}
+
+static void *storm_thread(void *arg)
+{
+  int kfd = *(int *)arg;
+  static struct input_event batch[STORM_BATCH_MAX * 3];
+  unsigned long long frame = 0; /* frames written */
+  unsigned long long base = 0;  /* frames written when the schedule started */
+  long long t0 = mono_us();
+
+  while (atomic_load(&storming))
+  {
+    if (atomic_load(&toggle_req))
+    {
+      storm_toggle(kfd);
+      atomic_store(&storm_paused, 1);
+      atomic_store(&toggle_req, 0);
+    }
+
+    if (atomic_load(&storm_paused))
+    {
+      /* No catch-up burst after a pause */
+      usleep(1000);
+      t0 = mono_us();
+      base = frame;
+      continue;
+    }
+
+    /* Frames due by now at opts.storm events/s, three events per frame */
+    unsigned long long due = base + (unsigned long long)(mono_us() - t0) * (unsigned long long)opts.storm / 3000000ULL;
+    size_t n = 0;
+    while (frame + n < due && n < STORM_BATCH_MAX)
+    {
+      storm_fill(&batch[n * 3], frame + n);
+      n++;
+    }
+
+    if (n)
+    {
+      if (write(kfd, batch, n * 3 * sizeof(batch[0])) < 0)
+      {
+        perror("storm write");
+        break;
+      }
+      frame += n;
+      atomic_fetch_add(&storm_events, n * 3);
+    }
+
+    usleep(1000);
+  }
+
+  return NULL;
+}
+
+static int status_enabled(void)
+{
+  char reply[REPLY_MAX];
+  if (ctl_request("status", reply, sizeof(reply)) <= 0) return -1;
+  return strstr(reply, "enabled=1") != NULL;
+}
+
+/* Taps the toggle key and waits for the daemon to report the new mode */
+static int storm_tap_and_wait(int was)
+{
+  atomic_store(&toggle_req, 1);
+  while (atomic_load(&toggle_req)) usleep(100);
+
+  for (int waited = 0; waited < 5000; waited++)
+  {
+    int now = status_enabled();
+    if (now >= 0 && now != was) return 0;
+    usleep(1000);
+  }
+  return -1;
+}
+
+static void storm_run(int kfd)
+{
+  pthread_t thread;
+  char reply[REPLY_MAX];
+  unsigned timeouts = 0;
+  long long t0 = mono_us();
+  long long end = t0 + (long long)opts.duration * 1000000LL;
+
+  printf("storm rate=%d/s duration=%ds\n", opts.storm, opts.duration);
+
+  atomic_store(&storming, 1);
+  pthread_create(&thread, NULL, storm_thread, &kfd);
+
+  while (mono_us() < end && !timeouts)
+  {
+    usleep(500 * 1000);
+
+    /* Off behind the backlog, then straight back on */
+    if (storm_tap_and_wait(1) < 0 || storm_tap_and_wait(0) < 0)
+      timeouts++;
+
+    atomic_store(&storm_paused, 0);
+  }
+
+  atomic_store(&storming, 0);
+  pthread_join(thread, NULL);
+  usleep(200 * 1000);
+
+  double secs = (mono_us() - t0) / 1e6;
+  printf("storm   injected_events=%llu (%.0f/s) mouse_frames=%llu (%.0f/s)\n",
+         (unsigned long long)atomic_load(&storm_events), atomic_load(&storm_events) / secs,
+         (unsigned long long)atomic_load(&mouse_frames), atomic_load(&mouse_frames) / secs);
+  samples_print("storm   toggle ", &toggle_lat);
+  if (timeouts) printf("storm   toggle  timed out waiting for the daemon\n");
+
+  if (ctl_request("stats", reply, sizeof(reply)) > 0)
+    printf("storm   daemon  %s", reply);
+
+  /* Leave mouse mode as we found it (on) */
+  if (status_enabled() == 0) ctl_request("enable", reply, sizeof(reply));
+}
+
+/* --- Daemon lifecycle --- */
+
+static pid_t daemon_spawn(void)
+{
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    char *argv[MAX_ARGS + 2];
+    int n = 0;
+    argv[n++] = (char *)opts.daemon;
+    for (int i = 0; i < opts.ndaemon_args; i++) argv[n++] = opts.daemon_args[i];
+    argv[n] = NULL;
+    execv(opts.daemon, argv);
+    perror("execv");
+    _exit(127);
+  }
+  return pid;
+}
+
+static int daemon_wait_ready(int timeout_ms)
+{
+  char reply[REPLY_MAX];
+  for (int waited = 0; waited < timeout_ms; waited += 100)
+  {
+    if (ctl_request("status", reply, sizeof(reply)) > 0) return 0;
+    usleep(100 * 1000);
+  }
+  return -1;
+}
+
+/* --- Main --- */
+
+static void usage(const char *argv0)
+{
+  fprintf(stderr,
+          "usage: %s [options] [-- daemon args]\n"
+          "  --daemon=PATH     start the daemon after creating the bench keyboard\n"
+          "  --clients=N       concurrent control clients in the loaded phase (default 4)\n"
+          "  --cmds=A,B,...    command mix (default status,stats,adaptive,startup-report)\n"
+          "  --rate=N          injected frames per second (default 100)\n"
+          "  --duration=S      seconds per phase (default 10)\n"
+          "  --laptop          inject laptop keyboard scancodes\n"
+          "  --storm=RATE      event storm of RATE events/s instead of the two phases\n"
+          "  --sock=PATH       control socket (default " CONTROL_SOCK ")\n",
+          argv0);
+}
+
+static void split_cmds(char *list)
+{
+  opts.ncmds = 0;
+  for (char *tok = strtok(list, ","); tok && opts.ncmds < MAX_CMDS; tok = strtok(NULL, ","))
+    opts.cmds[opts.ncmds++] = tok;
+}
+
+int main(int argc, char **argv)
+{
+  static char default_cmds[] = "status,stats,adaptive,startup-report";
+  char reply[REPLY_MAX];
+  pid_t daemon_pid = -1;
+  int was_enabled = 1;
+  int rc = 1;
+
+  split_cmds(default_cmds);
+
+  for (int i = 1; i < argc; i++)
+  {
+    const char *a = argv[i];
+
+    if (strcmp(a, "--") == 0)
+    {
+      for (i++; i < argc && opts.ndaemon_args < MAX_ARGS; i++)
+        opts.daemon_args[opts.ndaemon_args++] = argv[i];
+      break;
+    }
+    else if (strncmp(a, "--daemon=", 9) == 0) opts.daemon = a + 9;
+    else if (strncmp(a, "--clients=", 10) == 0) opts.clients = atoi(a + 10);
+    else if (strncmp(a, "--cmds=", 7) == 0) split_cmds(argv[i] + 7);
+    else if (strncmp(a, "--rate=", 7) == 0) opts.rate = atoi(a + 7);
+    else if (strncmp(a, "--duration=", 11) == 0) opts.duration = atoi(a + 11);
+    else if (strncmp(a, "--sock=", 7) == 0) opts.sock = a + 7;
+    else if (strcmp(a, "--laptop") == 0) opts.laptop = 1;
+    else if (strncmp(a, "--storm=", 8) == 0) opts.storm = atoi(a + 8);
+    else
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (opts.rate < 1 || opts.duration < 1 || opts.clients < 0 || !opts.ncmds || opts.storm < 0)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+
+  /* Two phases plus the attach probe */
+  inject_cap = (size_t)opts.rate * (size_t)opts.duration * 2 + 2;
+  inject_us = calloc(inject_cap, sizeof(*inject_us));
+  latency_us = calloc(inject_cap, sizeof(*latency_us));
+  if (!inject_us || !latency_us) return 1;
+
+  int kfd = bench_keyboard_create();
+  if (kfd < 0) return 1;
+  usleep(200 * 1000); /* let the event node appear */
+
+  if (opts.daemon)
+  {
+    daemon_pid = daemon_spawn();
+    if (daemon_pid < 0)
+    {
+      perror("fork");
+      goto out;
+    }
+  }
+  else
+  {
+    printf("Bench keyboard created. (Re)start the daemon now so it attaches it...\n");
+    fflush(stdout);
+  }
+
+  if (daemon_wait_ready(opts.daemon ? 5000 : 60000) < 0)
+  {
+    fprintf(stderr, "daemon not answering on %s\n", opts.sock);
+    goto out;
+  }
+
+  int mfd = -1;
+  for (int waited = 0; mfd < 0 && waited < 3000; waited += 100)
+  {
+    mfd = mouse_open();
+    if (mfd < 0) usleep(100 * 1000);
+  }
+  if (mfd < 0)
+  {
+    fprintf(stderr, "could not find \"%s\" under %s\n", MOUSE_NAME, DEV_INPUT);
+    goto out;
+  }
+
+  /* Mouse mode on; enabling parks and centres the pointer, skip that output */
+  if (ctl_request("status", reply, sizeof(reply)) > 0)
+    was_enabled = strstr(reply, "enabled=1") != NULL;
+  if (!was_enabled) ctl_request("enable", reply, sizeof(reply));
+  usleep(500 * 1000);
+  mouse_drain(mfd);
+
+  pthread_t reader;
+  pthread_create(&reader, NULL, reader_thread, &mfd);
+
+  /* Probe: the daemon must have attached the bench keyboard */
+  inject_frame(kfd, 0);
+  inject_frame(kfd, 1);
+  usleep(500 * 1000);
+  if (atomic_load(&matched) < 2)
+  {
+    fprintf(stderr, "no mouse output for injected keys; was the daemon started after bench?\n");
+    atomic_store(&reading, 0);
+    pthread_join(reader, NULL);
+    close(mfd);
+    goto restore;
+  }
+  ctl_request("stats reset", reply, sizeof(reply));
+
+  if (opts.storm)
+  {
+    storm_run(kfd);
+    goto done;
+  }
+
+  printf("rate=%d/s duration=%ds clients=%d cmds=", opts.rate, opts.duration, opts.clients);
+  for (int i = 0; i < opts.ncmds; i++) printf("%s%s", i ? "," : "", opts.cmds[i]);
+  printf("\n");
+
+  /* Phase 1: input only */
+  size_t idle_first = inject_phase(kfd, opts.duration);
+  size_t idle_end = atomic_load(&injected);
+  phase_report("idle", idle_first, idle_end);
+
+  /* Phase 2: input under control load */
+  client_t *clients = calloc((size_t)opts.clients + 1, sizeof(*clients));
+  long long t_load = mono_us();
+  atomic_store(&loading, 1);
+  for (int i = 0; i < opts.clients; i++)
+  {
+    clients[i].id = i;
+    pthread_create(&clients[i].thread, NULL, client_thread, &clients[i]);
+  }
+
+  size_t load_first = inject_phase(kfd, opts.duration);
+  size_t load_end = atomic_load(&injected);
+
+  atomic_store(&loading, 0);
+  samples_t rtt = {0};
+  unsigned errors = 0;
+  for (int i = 0; i < opts.clients; i++)
+  {
+    pthread_join(clients[i].thread, NULL);
+    for (size_t k = 0; k < clients[i].rtt.n; k++) samples_add(&rtt, clients[i].rtt.v[k]);
+    errors += clients[i].errors;
+    free(clients[i].rtt.v);
+  }
+  double secs = (mono_us() - t_load) / 1e6;
+  free(clients);
+
+  phase_report("loaded", load_first, load_end);
+  printf("control commands=%zu rate=%.0f/s errors=%u\n", rtt.n, rtt.n / secs, errors);
+  samples_print("control rtt    ", &rtt);
+  free(rtt.v);
+  if (atomic_load(&extra)) printf("note: %u unmatched mouse frames (keys pressed during the run?)\n", atomic_load(&extra));
+
+done:
+  atomic_store(&reading, 0);
+  pthread_join(reader, NULL);
+  close(mfd);
+  rc = 0;
+
+restore:
+  if (!was_enabled) ctl_request("disable", reply, sizeof(reply));
+
+out:
+  if (daemon_pid > 0)
+  {
+    ctl_request("quit", reply, sizeof(reply));
+    waitpid(daemon_pid, NULL, 0);
+  }
+  ioctl(kfd, UI_DEV_DESTROY);
+  close(kfd);
+  return rc;
+}
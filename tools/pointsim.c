@@ -0,0 +1,402 @@
+/*
+ * pointsim - offline pointing-throughput simulator for FlipMouse
+ *
+ * Drives the daemon's own motion code (../motion.c) with a simulated user
+ * and scores a motion profile by keypresses and time-to-target.
+ *
+ * Model:
+ * - Random square targets on a 240x320 screen (Fitts's law style: the
+ *   distance D and width W of every trial give ID = log2(D/W + 1)).
+ * - The user fixes one axis at a time. Short distances are tapped, long
+ *   ones are held. A tap is press + release before autorepeat kicks in.
+ *   While a key is held the kernel autorepeats it.
+ * - The user lets go when they see the pointer enter (or jump past) the
+ *   target. The release lands one reaction time later, so every repeat in
+ *   between is overshoot that needs correcting.
+ * - After a hold overshoots, the user taps the rest of the way on that
+ *   axis. With acceleration every hold overshoots, and holding back would
+ *   just overshoot again.
+ * - Every press, repeat and release moves the pointer, as in the daemon.
+ *
+ * Everything is seeded, so two runs with the same flags give identical
+ * results. Several --profile flags are scored against the same targets.
+ * A target not reached within MAX_PRESSES counts as a failure at the cost
+ * it ran up, with no bits towards throughput, so every profile's means
+ * cover the same targets.
+ *
+ * Build (host):  cc -O2 -o pointsim tools/pointsim.c motion.c
+ *           or:  ./make-mouse --tools
+ *
+ * Example:
+ *   pointsim --profile=4,0,0 --profile=3,1,12 --profile=4,0,0,adaptive
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../motion.h"
+
+#define MAX_PROFILES 16
+#define MAX_PRESSES 100 /* per target; more counts as a failure */
+#define TAP_MAX_EVENTS 6 /* up to 3 taps (press + release each) before holding */
+
+/* Simulation parameters */
+typedef struct
+{
+  int width;
+  int height;
+  int trials;
+  unsigned long long seed;
+  double rt_ms;           /* visual reaction time, mean */
+  double rt_sd_ms;
+  double repeat_delay_ms; /* autorepeat delay */
+  double repeat_ms;       /* autorepeat period */
+  double tap_hold_ms;
+  double tap_gap_ms;      /* between taps of a burst, mean */
+  double tap_gap_sd_ms;
+  int min_target;         /* target side, pixels */
+  int max_target;
+} sim_params_t;
+
+typedef struct
+{
+  motion_profile_t profile;
+  int adaptive;
+} sim_profile_t;
+
+/* Per-profile results */
+typedef struct
+{
+  double keypresses;
+  double time_ms;
+  double throughput; /* bits/s */
+  double *times;     /* per-trial time-to-target, for percentiles */
+  int failures;
+  int final_gain;
+} sim_result_t;
+
+/* Simulation state for one trial */
+typedef struct
+{
+  motion_t *motion;
+  const sim_params_t *p;
+  unsigned long long rng;
+  double t;  /* ms */
+  int x, y;
+  int presses;
+} sim_t;
+
+/* --- Deterministic RNG (xorshift64*) --- */
+
+static double rng_uniform(unsigned long long *s)
+{
+  *s ^= *s >> 12;
+  *s ^= *s << 25;
+  *s ^= *s >> 27;
+  return (double)((*s * 2685821657736338717ULL) >> 11) / 9007199254740992.0;
+}
+
+static double rng_gauss(unsigned long long *s, double mean, double sd)
+{
+  double u1 = rng_uniform(s);
+  double u2 = rng_uniform(s);
+  if (u1 < 1e-12) u1 = 1e-12;
+  return mean + sd * sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+static double rng_positive(unsigned long long *s, double mean, double sd)
+{
+  double v = rng_gauss(s, mean, sd);
+  return v < mean * 0.25 ? mean * 0.25 : v;
+}
+
+/* --- Simulated user --- */
+
+static int clampi(int v, int lo, int hi)
+{
+  return v < lo ? lo : (v > hi ? hi : v);
+}
+
+/* One arrow event reaching the daemon at sim->t */
+static void sim_event(sim_t *sim, motion_dir_t dir)
+{
+  int step = motion_step(sim->motion, dir, (long long)sim->t);
+
+  switch (dir)
+  {
+  case MOTION_UP:    sim->y -= step; break;
+  case MOTION_DOWN:  sim->y += step; break;
+  case MOTION_LEFT:  sim->x -= step; break;
+  case MOTION_RIGHT: sim->x += step; break;
+  }
+
+  sim->x = clampi(sim->x, 0, sim->p->width - 1);
+  sim->y = clampi(sim->y, 0, sim->p->height - 1);
+}
+
+static int sim_axis_pos(const sim_t *sim, int axis)
+{
+  return axis ? sim->y : sim->x;
+}
+
+/* Signed distance from the pointer to the target centre along an axis */
+static int sim_axis_dist(const sim_t *sim, int axis, int tx, int ty)
+{
+  return axis ? ty - sim->y : tx - sim->x;
+}
+
+static void sim_tap(sim_t *sim, motion_dir_t dir)
+{
+  const sim_params_t *p = sim->p;
+
+  sim->presses++;
+  sim_event(sim, dir);
+  sim->t += p->tap_hold_ms;
+  sim_event(sim, dir);
+  sim->t += rng_positive(&sim->rng, p->tap_gap_ms, p->tap_gap_sd_ms);
+}
+
+/*
+ * Hold dir until the pointer is seen inside or past the target, then
+ * release one reaction time later. Afterwards the user needs another
+ * reaction time to take in where it stopped. Returns 1 if it stopped
+ * past the target.
+ */
+static int sim_hold(sim_t *sim, motion_dir_t dir, int axis, int tx, int ty, int half)
+{
+  const sim_params_t *p = sim->p;
+  int start_sign = sim_axis_dist(sim, axis, tx, ty) > 0 ? 1 : -1;
+  double release_at = -1;
+  double next;
+
+  sim->presses++;
+  sim_event(sim, dir);
+  next = sim->t + p->repeat_delay_ms;
+
+  for (;;)
+  {
+    int d = sim_axis_dist(sim, axis, tx, ty);
+    int edge = sim_axis_pos(sim, axis) == 0 ||
+               sim_axis_pos(sim, axis) == (axis ? p->height : p->width) - 1;
+
+    if (release_at < 0 && (abs(d) <= half || d * start_sign < 0 || edge))
+      release_at = sim->t + rng_positive(&sim->rng, p->rt_ms, p->rt_sd_ms);
+
+    if (release_at >= 0 && release_at <= next) break;
+
+    sim->t = next;
+    sim_event(sim, dir);
+    next += p->repeat_ms;
+  }
+
+  sim->t = release_at;
+  sim_event(sim, dir);
+  sim->t += rng_positive(&sim->rng, p->rt_ms, p->rt_sd_ms);
+
+  int d = sim_axis_dist(sim, axis, tx, ty);
+  return abs(d) > half && d * start_sign < 0;
+}
+
+/* Returns 0 when the pointer ends inside the target */
+static int sim_trial(sim_t *sim, int tx, int ty, int size)
+{
+  int half = size / 2;
+  int overshot[2] = {0, 0}; /* per axis: tap from now on */
+
+  /* Notice the target first */
+  sim->t += rng_positive(&sim->rng, sim->p->rt_ms, sim->p->rt_sd_ms);
+
+  while (sim->presses < MAX_PRESSES)
+  {
+    int dx = sim_axis_dist(sim, 0, tx, ty);
+    int dy = sim_axis_dist(sim, 1, tx, ty);
+    int axis;
+
+    if (abs(dx) <= half && abs(dy) <= half) return 0;
+
+    /* Fix the axis that is furthest off first */
+    if (abs(dx) > half && (abs(dx) >= abs(dy) || abs(dy) <= half))
+      axis = 0;
+    else
+      axis = 1;
+
+    int d = axis ? dy : dx;
+    motion_dir_t dir = axis ? (d > 0 ? MOTION_DOWN : MOTION_UP)
+                            : (d > 0 ? MOTION_RIGHT : MOTION_LEFT);
+
+    /* The user knows roughly how far one event moves the pointer */
+    int step = motion_base_speed(sim->motion);
+    int events = (abs(d) - half + step - 1) / step;
+
+    if (events <= TAP_MAX_EVENTS || overshot[axis])
+      sim_tap(sim, dir);
+    else
+      overshot[axis] = sim_hold(sim, dir, axis, tx, ty, half);
+  }
+
+  return -1;
+}
+
+/* --- Driver --- */
+
+static int cmp_double(const void *a, const void *b)
+{
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static void run_profile(const sim_params_t *p, const sim_profile_t *prof, sim_result_t *res)
+{
+  motion_t motion;
+  unsigned long long targets = p->seed * 0x9E3779B97F4A7C15ULL + 1;
+  sim_t sim;
+
+  motion_init(&motion, &prof->profile);
+  motion.adaptive = prof->adaptive;
+
+  memset(&sim, 0, sizeof(sim));
+  sim.motion = &motion;
+  sim.p = p;
+  sim.rng = p->seed * 0xD1B54A32D192ED03ULL + 7;
+  sim.x = p->width / 2;
+  sim.y = p->height / 2;
+
+  memset(res, 0, sizeof(*res));
+  res->times = (double *)calloc((size_t)p->trials, sizeof(double));
+
+  for (int i = 0; i < p->trials; i++)
+  {
+    /* Same target sequence for every profile */
+    int size = p->min_target + (int)(rng_uniform(&targets) * (p->max_target - p->min_target + 1));
+    int tx = size / 2 + (int)(rng_uniform(&targets) * (p->width - size));
+    int ty = size / 2 + (int)(rng_uniform(&targets) * (p->height - size));
+
+    double dist = hypot(tx - sim.x, ty - sim.y);
+    double t0 = sim.t;
+    int presses0 = sim.presses;
+
+    int failed = sim_trial(&sim, tx, ty, size) < 0;
+
+    double mt = sim.t - t0;
+    res->keypresses += sim.presses - presses0;
+    res->time_ms += mt;
+    res->times[i] = mt;
+    sim.presses = 0;
+
+    if (failed)
+    {
+      res->failures++;
+      /* Start the next target from somewhere sane */
+      sim.x = tx;
+      sim.y = ty;
+      continue;
+    }
+
+    res->throughput += log2(dist / size + 1.0) / (mt / 1000.0);
+  }
+
+  res->final_gain = motion.gain;
+}
+
+static void usage(const char *argv0)
+{
+  fprintf(stderr,
+          "usage: %s [options]\n"
+          "  --profile=SPEED,ACCEL,MAX[,adaptive]  profile to score (repeatable, default 4,0,0)\n"
+          "  --trials=N          targets per profile (default 1000)\n"
+          "  --seed=N            RNG seed (default 1)\n"
+          "  --screen=WxH        screen size (default 240x320)\n"
+          "  --target=MIN,MAX    target side range in pixels (default 8,32)\n"
+          "  --rt=MEAN,SD        reaction time in ms (default 250,40)\n"
+          "  --repeat=DELAY,PERIOD  autorepeat in ms (default 250,33)\n"
+          "  --tap=HOLD,GAP,SD   tap timing in ms (default 90,200,40)\n",
+          argv0);
+}
+
+int main(int argc, char **argv)
+{
+  sim_params_t p = {240, 320, 1000, 1, 250, 40, 250, 33, 90, 200, 40, 8, 32};
+  sim_profile_t profiles[MAX_PROFILES];
+  int nprofiles = 0;
+
+  for (int i = 1; i < argc; i++)
+  {
+    const char *a = argv[i];
+
+    if (strncmp(a, "--profile=", 10) == 0 && nprofiles < MAX_PROFILES)
+    {
+      sim_profile_t *pr = &profiles[nprofiles];
+      char flag[16] = "";
+      memset(pr, 0, sizeof(*pr));
+      if (sscanf(a + 10, "%d,%d,%d,%15s", &pr->profile.speed, &pr->profile.accel,
+                 &pr->profile.max_speed, flag) < 1 || pr->profile.speed < 1)
+      {
+        usage(argv[0]);
+        return 1;
+      }
+      pr->adaptive = strcmp(flag, "adaptive") == 0;
+      nprofiles++;
+    }
+    else if (strncmp(a, "--trials=", 9) == 0) p.trials = atoi(a + 9);
+    else if (strncmp(a, "--seed=", 7) == 0) p.seed = strtoull(a + 7, NULL, 10);
+    else if (strncmp(a, "--screen=", 9) == 0) sscanf(a + 9, "%dx%d", &p.width, &p.height);
+    else if (strncmp(a, "--target=", 9) == 0) sscanf(a + 9, "%d,%d", &p.min_target, &p.max_target);
+    else if (strncmp(a, "--rt=", 5) == 0) sscanf(a + 5, "%lf,%lf", &p.rt_ms, &p.rt_sd_ms);
+    else if (strncmp(a, "--repeat=", 9) == 0) sscanf(a + 9, "%lf,%lf", &p.repeat_delay_ms, &p.repeat_ms);
+    else if (strncmp(a, "--tap=", 6) == 0)
+      sscanf(a + 6, "%lf,%lf,%lf", &p.tap_hold_ms, &p.tap_gap_ms, &p.tap_gap_sd_ms);
+    else
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (p.trials < 1 || p.width < 2 || p.height < 2 || p.min_target < 1 ||
+      p.max_target < p.min_target || p.max_target > p.width || p.max_target > p.height)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (!nprofiles)
+  {
+    memset(&profiles[0], 0, sizeof(profiles[0]));
+    profiles[0].profile.speed = 4;
+    nprofiles = 1;
+  }
+
+  printf("screen=%dx%d trials=%d seed=%llu target=%d..%dpx rt=%.0f+-%.0fms repeat=%.0f/%.0fms\n",
+         p.width, p.height, p.trials, p.seed, p.min_target, p.max_target,
+         p.rt_ms, p.rt_sd_ms, p.repeat_delay_ms, p.repeat_ms);
+  printf("%-22s %10s %10s %10s %10s %9s %6s\n",
+         "profile", "keypresses", "mean_ms", "p90_ms", "tp_bits/s", "failures", "gain");
+
+  for (int i = 0; i < nprofiles; i++)
+  {
+    sim_result_t res;
+    char name[32];
+
+    run_profile(&p, &profiles[i], &res);
+
+    snprintf(name, sizeof(name), "%d,%d,%d%s",
+             profiles[i].profile.speed, profiles[i].profile.accel,
+             profiles[i].profile.max_speed, profiles[i].adaptive ? ",adaptive" : "");
+
+    qsort(res.times, (size_t)p.trials, sizeof(double), cmp_double);
+    printf("%-22s %10.2f %10.0f %10.0f %10.2f %9d %6.2f\n",
+           name,
+           res.keypresses / p.trials,
+           res.time_ms / p.trials,
+           res.times[(p.trials * 9) / 10],
+           res.throughput / p.trials,
+           res.failures,
+           (double)res.final_gain / MOTION_GAIN_ONE);
+    free(res.times);
+  }
+
+  return 0;
+}